@@ -0,0 +1,54 @@
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include "logging.hpp"
+
+int main(int argc, char *argv[]) {
+    using http::server3::logging::access_record;
+    using http::server3::logging::access_log_magic;
+
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <access log>\n";
+        return 1;
+    }
+
+    std::FILE *file = std::fopen(argv[1], "rb");
+    if (!file) {
+        std::cerr << "cannot open " << argv[1] << "\n";
+        return 1;
+    }
+
+    char magic[sizeof(access_log_magic)];
+    if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic)
+        || std::memcmp(magic, access_log_magic, sizeof(magic)) != 0) {
+        std::cerr << argv[1] << " is not an access log\n";
+        std::fclose(file);
+        return 1;
+    }
+
+    access_record record;
+    char text[512];
+    while (std::fread(&record, sizeof(record), 1, file) == 1) {
+        std::size_t length = record.path_length + record.range_length;
+        if (std::fread(text, 1, length, file) != length) {
+            std::cerr << "truncated record\n";
+            break;
+        }
+
+        std::time_t seconds = static_cast<std::time_t>(record.time_us / 1000000);
+        std::tm utc;
+        gmtime_r(&seconds, &utc);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+        std::printf("%s.%06dZ %u %llu %uus %.*s %.*s\n", stamp, static_cast<int>(record.time_us % 1000000),
+                    static_cast<unsigned int>(record.status), static_cast<unsigned long long>(record.bytes),
+                    static_cast<unsigned int>(record.latency_us), static_cast<int>(record.path_length), text,
+                    record.range_length ? static_cast<int>(record.range_length) : 1,
+                    record.range_length ? text + record.path_length : "-");
+    }
+
+    std::fclose(file);
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include "admission_control.hpp"
+#include <algorithm>
+#include <boost/asio/placeholders.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "reply.hpp"
+
+namespace http {
+    namespace server3 {
+
+        namespace {
+            const std::chrono::milliseconds probe_interval(50);
+
+            const char *const reason_names[] = {"connections", "inflight_bytes", "queue_delay"};
+        }
+
+        admission_control::probe::probe(admission_control &owner, boost::asio::io_context &io_context)
+                : delay_ns_(owner.queue_delays_ns_[owner.probe_count_.fetch_add(1) % max_probes]),
+                  timer_(io_context) {
+            if (owner.limits_.max_queue_delay.count() > 0)
+                arm();
+        }
+
+        admission_control::probe::~probe() {
+            delay_ns_.store(0, std::memory_order_relaxed);
+        }
+
+        void admission_control::probe::arm() {
+            timer_.expires_after(probe_interval);
+            timer_.async_wait(boost::bind(&probe::handle_timer, this, boost::asio::placeholders::error));
+        }
+
+        void admission_control::probe::handle_timer(const boost::system::error_code &e) {
+            if (e)
+                return;
+
+            boost::int64_t sample = std::max<boost::int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - timer_.expiry()).count());
+            boost::int64_t previous = delay_ns_.load(std::memory_order_relaxed);
+            delay_ns_.store(previous + (sample - previous) / 4, std::memory_order_relaxed);
+            arm();
+        }
+
+        admission_control::admission_control(const limits &l)
+                : limits_(l),
+                  connections_(0),
+                  inflight_bytes_(0),
+                  probe_count_(0) {
+            for (int i = 0; i < reason_count; ++i)
+                rejected_[i].store(0, std::memory_order_relaxed);
+            for (std::size_t i = 0; i < max_probes; ++i)
+                queue_delays_ns_[i].store(0, std::memory_order_relaxed);
+
+            reply rep = reply::stock_reply(reply::service_unavailable);
+            header retry_after;
+            retry_after.name = "Retry-After";
+            retry_after.value = boost::lexical_cast<std::string>(limits_.retry_after);
+            rep.headers.push_back(retry_after);
+            header connection;
+            connection.name = "Connection";
+            connection.value = "close";
+            rep.headers.push_back(connection);
+            std::vector<boost::asio::const_buffer> buffers = rep.to_buffers();
+            for (std::size_t i = 0; i + 2 < buffers.size(); ++i)
+                rejection_head_.append(static_cast<const char *>(buffers[i].data()), buffers[i].size());
+            rejection_head_ += "Date: ";
+            rejection_body_ = rep.content;
+
+            collector_ = metrics::add_collector(boost::bind(&admission_control::render, this, _1));
+        }
+
+        admission_control::~admission_control() {
+            metrics::remove_collector(collector_);
+        }
+
+        void admission_control::connection_opened() {
+            connections_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void admission_control::connection_closed() {
+            connections_.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void admission_control::reserve(unsigned long long bytes) {
+            inflight_bytes_.fetch_add(static_cast<boost::int64_t>(bytes), std::memory_order_relaxed);
+        }
+
+        void admission_control::release(unsigned long long bytes) {
+            inflight_bytes_.fetch_sub(static_cast<boost::int64_t>(bytes), std::memory_order_relaxed);
+        }
+
+        bool admission_control::admit(bool first_request) {
+            if (first_request && limits_.max_connections > 0
+                && connections_.load(std::memory_order_relaxed) > static_cast<boost::int64_t>(limits_.max_connections)) {
+                reject(too_many_connections);
+                return false;
+            }
+            if (limits_.max_inflight_bytes > 0
+                && inflight_bytes_.load(std::memory_order_relaxed)
+                   >= static_cast<boost::int64_t>(limits_.max_inflight_bytes)) {
+                reject(too_many_inflight_bytes);
+                return false;
+            }
+            if (limits_.max_queue_delay.count() > 0
+                && queue_delay_ns() > std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        limits_.max_queue_delay).count()) {
+                reject(queue_delay_exceeded);
+                return false;
+            }
+            return true;
+        }
+
+        boost::int64_t admission_control::queue_delay_ns() const {
+            boost::int64_t delay = 0;
+            std::size_t count = std::min(probe_count_.load(std::memory_order_relaxed), max_probes);
+            for (std::size_t i = 0; i < count; ++i)
+                delay = std::max(delay, queue_delays_ns_[i].load(std::memory_order_relaxed));
+            return delay;
+        }
+
+        void admission_control::reject(reason r) {
+            rejected_[r].fetch_add(1, std::memory_order_relaxed);
+            HTTP_SERVER3_LOG(debug, "Shedding a request over the " << reason_names[r] << " limit");
+        }
+
+        void admission_control::render(std::string &out) {
+            out += "# HELP http_admission_max_connections Open connections above which new clients are refused.\n"
+                   "# TYPE http_admission_max_connections gauge\n"
+                   "http_admission_max_connections " + std::to_string(limits_.max_connections) + "\n";
+            out += "# HELP http_admission_max_inflight_bytes Bytes of responses in progress above which requests are refused.\n"
+                   "# TYPE http_admission_max_inflight_bytes gauge\n"
+                   "http_admission_max_inflight_bytes " + std::to_string(limits_.max_inflight_bytes) + "\n";
+            out += "# HELP http_admission_max_queue_delay_seconds Event loop delay above which requests are refused.\n"
+                   "# TYPE http_admission_max_queue_delay_seconds gauge\n"
+                   "http_admission_max_queue_delay_seconds "
+                   + std::to_string(limits_.max_queue_delay.count() / 1e3) + "\n";
+            out += "# HELP http_inflight_response_bytes Bytes of responses currently being written.\n"
+                   "# TYPE http_inflight_response_bytes gauge\n"
+                   "http_inflight_response_bytes "
+                   + std::to_string(inflight_bytes_.load(std::memory_order_relaxed)) + "\n";
+            out += "# HELP http_io_queue_delay_seconds Smoothed lateness of timers on the busiest event loop.\n"
+                   "# TYPE http_io_queue_delay_seconds gauge\n"
+                   "http_io_queue_delay_seconds " + std::to_string(queue_delay_ns() / 1e9) + "\n";
+            out += "# HELP http_requests_shed_total Requests answered with 503 by admission control.\n"
+                   "# TYPE http_requests_shed_total counter\n";
+            for (int i = 0; i < reason_count; ++i)
+                out += "http_requests_shed_total{reason=\"" + std::string(reason_names[i]) + "\"} "
+                       + std::to_string(rejected_[i].load(std::memory_order_relaxed)) + "\n";
+        }
+
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef HTTP_SERVER3_ADMISSION_CONTROL_HPP
+#define HTTP_SERVER3_ADMISSION_CONTROL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace http {
+    namespace server3 {
+
+        class admission_control : private boost::noncopyable {
+        public:
+            struct limits {
+                limits() : max_connections(0), max_inflight_bytes(0), max_queue_delay(0), retry_after(1) {}
+
+                unsigned long long max_connections;
+
+                unsigned long long max_inflight_bytes;
+
+                std::chrono::milliseconds max_queue_delay;
+
+                unsigned int retry_after;
+            };
+
+            class probe : private boost::noncopyable {
+            public:
+                probe(admission_control &owner, boost::asio::io_context &io_context);
+
+                ~probe();
+
+            private:
+                void arm();
+
+                void handle_timer(const boost::system::error_code &e);
+
+                std::atomic<boost::int64_t> &delay_ns_;
+
+                boost::asio::steady_timer timer_;
+            };
+
+            explicit admission_control(const limits &l);
+
+            ~admission_control();
+
+            void connection_opened();
+
+            void connection_closed();
+
+            void reserve(unsigned long long bytes);
+
+            void release(unsigned long long bytes);
+
+            bool admit(bool first_request);
+
+            const std::string &rejection_head() const {
+                return rejection_head_;
+            }
+
+            const std::string &rejection_body() const {
+                return rejection_body_;
+            }
+
+            unsigned int retry_after() const {
+                return limits_.retry_after;
+            }
+
+        private:
+            enum reason {
+                too_many_connections, too_many_inflight_bytes, queue_delay_exceeded, reason_count
+            };
+
+            boost::int64_t queue_delay_ns() const;
+
+            void reject(reason r);
+
+            void render(std::string &out);
+
+            limits limits_;
+
+            std::atomic<boost::int64_t> connections_;
+
+            std::atomic<boost::int64_t> inflight_bytes_;
+
+            std::atomic<boost::uint64_t> rejected_[reason_count];
+
+            static const std::size_t max_probes = 256;
+
+            std::atomic<boost::int64_t> queue_delays_ns_[max_probes];
+
+            std::atomic<std::size_t> probe_count_;
+
+            std::string rejection_head_;
+
+            std::string rejection_body_;
+
+            std::size_t collector_;
+        };
+
+    }
+}
+
+#endif
@@ -0,0 +1,221 @@
+#include "bandwidth_shaper.hpp"
+#include <algorithm>
+#include <boost/asio/placeholders.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+#include "metrics.hpp"
+
+namespace http {
+    namespace server3 {
+
+        namespace {
+            const std::chrono::milliseconds tick(10);
+
+            const std::size_t slot_count = 256;
+
+            const double burst_seconds = 0.25;
+
+            const std::size_t min_grant = 16 * 1024;
+
+            const std::chrono::seconds rate_window(1);
+
+            const std::size_t reported_clients = 10;
+
+            void configure(bandwidth_shaper::token_bucket &bucket, unsigned long long rate,
+                           std::chrono::steady_clock::time_point now) {
+                bucket.rate = static_cast<double>(rate);
+                bucket.burst = std::max(bucket.rate * burst_seconds, static_cast<double>(min_grant));
+                bucket.tokens = bucket.burst;
+                bucket.updated = now;
+            }
+
+            double seconds(std::chrono::steady_clock::duration d) {
+                return std::chrono::duration_cast<std::chrono::duration<double> >(d).count();
+            }
+
+            void roll(bandwidth_shaper::client &c, std::chrono::steady_clock::time_point now) {
+                std::chrono::steady_clock::duration elapsed = now - c.window_start;
+                if (elapsed < rate_window)
+                    return;
+                c.current_rate = c.window_bytes / seconds(elapsed);
+                c.window_start = now;
+                c.window_bytes = 0;
+            }
+
+            bool faster(const boost::shared_ptr<bandwidth_shaper::client> &a,
+                        const boost::shared_ptr<bandwidth_shaper::client> &b) {
+                return a->current_rate > b->current_rate;
+            }
+        }
+
+        void bandwidth_shaper::token_bucket::refill(std::chrono::steady_clock::time_point now) {
+            if (rate <= 0 || now <= updated)
+                return;
+            tokens = std::min(burst, tokens + rate * seconds(now - updated));
+            updated = now;
+        }
+
+        bandwidth_shaper::bandwidth_shaper(boost::asio::io_context &io_context, unsigned long long client_rate,
+                                           unsigned long long connection_rate)
+                : client_rate_(client_rate),
+                  connection_rate_(connection_rate),
+                  sweep_at_(64),
+                  slots_(slot_count),
+                  cursor_(0),
+                  waiting_(0),
+                  armed_(false),
+                  timer_(io_context) {
+            collector_ = metrics::add_collector(boost::bind(&bandwidth_shaper::render, this, _1));
+        }
+
+        bandwidth_shaper::~bandwidth_shaper() {
+            metrics::remove_collector(collector_);
+        }
+
+        void bandwidth_shaper::attach(stream &s, const boost::asio::ip::address &address) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            configure(s.bucket, connection_rate_, now);
+            s.owner.reset();
+            if (client_rate_ == 0)
+                return;
+
+            std::string key = address.to_string();
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            boost::weak_ptr<client> &slot = clients_[key];
+            s.owner = slot.lock();
+            if (s.owner)
+                return;
+
+            s.owner.reset(new client());
+            configure(s.owner->bucket, client_rate_, now);
+            s.owner->address = key;
+            s.owner->window_start = now;
+            slot = s.owner;
+
+            if (clients_.size() >= sweep_at_) {
+                for (client_map::iterator it = clients_.begin(); it != clients_.end();) {
+                    if (it->second.expired())
+                        it = clients_.erase(it);
+                    else
+                        ++it;
+                }
+                sweep_at_ = std::max<std::size_t>(64, clients_.size() * 2);
+            }
+        }
+
+        std::size_t bandwidth_shaper::acquire(stream &s, std::size_t wanted) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            double available = static_cast<double>(wanted);
+            if (s.bucket.rate > 0) {
+                s.bucket.refill(now);
+                available = std::min(available, s.bucket.tokens);
+            }
+            if (s.owner) {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                s.owner->bucket.refill(now);
+                available = std::min(available, s.owner->bucket.tokens);
+            }
+            if (available < std::min(wanted, min_grant))
+                return 0;
+            return static_cast<std::size_t>(available);
+        }
+
+        void bandwidth_shaper::consume(stream &s, std::size_t bytes) {
+            if (s.bucket.rate > 0)
+                s.bucket.tokens -= bytes;
+            if (s.owner) {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                s.owner->bucket.tokens -= bytes;
+                s.owner->window_bytes += bytes;
+                roll(*s.owner, std::chrono::steady_clock::now());
+            }
+        }
+
+        void bandwidth_shaper::wait(stream &s, std::size_t wanted, const boost::shared_ptr<waiter> &w) {
+            metrics::record_event(metrics::bandwidth_throttled);
+            double needed = static_cast<double>(std::min(wanted, min_grant)), delay = 0;
+            if (s.bucket.rate > 0)
+                delay = std::max(delay, (needed - s.bucket.tokens) / s.bucket.rate);
+
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            if (s.owner)
+                delay = std::max(delay, (needed - s.owner->bucket.tokens) / s.owner->bucket.rate);
+
+            std::size_t ticks = static_cast<std::size_t>(delay / seconds(tick)) + 1;
+            ticks = std::min(ticks, slot_count - 1);
+            if (waiting_ == 0 && !armed_)
+                cursor_time_ = std::chrono::steady_clock::now();
+            slots_[(cursor_ + ticks) % slot_count].push_back(w);
+            ++waiting_;
+            arm();
+        }
+
+        void bandwidth_shaper::arm() {
+            if (armed_)
+                return;
+            armed_ = true;
+            timer_.expires_at(cursor_time_ + tick);
+            timer_.async_wait(boost::bind(&bandwidth_shaper::handle_tick, this, boost::asio::placeholders::error));
+        }
+
+        void bandwidth_shaper::handle_tick(const boost::system::error_code &e) {
+            if (e)
+                return;
+
+            std::vector<boost::shared_ptr<waiter> > due;
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                armed_ = false;
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                while (cursor_time_ + tick <= now && waiting_ > due.size()) {
+                    cursor_ = (cursor_ + 1) % slot_count;
+                    cursor_time_ += tick;
+                    std::vector<boost::shared_ptr<waiter> > &slot = slots_[cursor_];
+                    due.insert(due.end(), slot.begin(), slot.end());
+                    slot.clear();
+                }
+                waiting_ -= due.size();
+                if (waiting_ > 0)
+                    arm();
+            }
+            for (std::size_t i = 0; i < due.size(); ++i)
+                due[i]->resume();
+        }
+
+        void bandwidth_shaper::render(std::string &out) {
+            std::vector<boost::shared_ptr<client> > active;
+            std::size_t waiting;
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                for (client_map::const_iterator it = clients_.begin(); it != clients_.end(); ++it) {
+                    if (boost::shared_ptr<client> c = it->second.lock()) {
+                        roll(*c, now);
+                        active.push_back(c);
+                    }
+                }
+                std::sort(active.begin(), active.end(), faster);
+                waiting = waiting_;
+            }
+
+            out += "# HELP http_shaping_client_rate_limit_bytes Body bytes per second allowed per client IP.\n"
+                   "# TYPE http_shaping_client_rate_limit_bytes gauge\n"
+                   "http_shaping_client_rate_limit_bytes " + std::to_string(client_rate_) + "\n";
+            out += "# HELP http_shaping_connection_rate_limit_bytes Body bytes per second allowed per connection.\n"
+                   "# TYPE http_shaping_connection_rate_limit_bytes gauge\n"
+                   "http_shaping_connection_rate_limit_bytes " + std::to_string(connection_rate_) + "\n";
+            out += "# HELP http_shaping_clients Client IPs with open shaped connections.\n"
+                   "# TYPE http_shaping_clients gauge\n"
+                   "http_shaping_clients " + std::to_string(active.size()) + "\n";
+            out += "# HELP http_shaping_waiting_connections Connections waiting for bandwidth tokens.\n"
+                   "# TYPE http_shaping_waiting_connections gauge\n"
+                   "http_shaping_waiting_connections " + std::to_string(waiting) + "\n";
+            out += "# HELP http_shaping_client_rate_bytes Recent body bytes per second of the busiest clients.\n"
+                   "# TYPE http_shaping_client_rate_bytes gauge\n";
+            for (std::size_t i = 0; i < active.size() && i < reported_clients; ++i)
+                out += "http_shaping_client_rate_bytes{client=\"" + active[i]->address + "\"} "
+                       + std::to_string(static_cast<unsigned long long>(active[i]->current_rate)) + "\n";
+        }
+
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef HTTP_SERVER3_BANDWIDTH_SHAPER_HPP
+#define HTTP_SERVER3_BANDWIDTH_SHAPER_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/weak_ptr.hpp>
+
+namespace http {
+    namespace server3 {
+
+        class bandwidth_shaper : private boost::noncopyable {
+        public:
+            struct token_bucket {
+                token_bucket() : rate(0), burst(0), tokens(0) {}
+
+                void refill(std::chrono::steady_clock::time_point now);
+
+                double rate;
+
+                double burst;
+
+                double tokens;
+
+                std::chrono::steady_clock::time_point updated;
+            };
+
+            struct client {
+                client() : window_bytes(0), current_rate(0) {}
+
+                token_bucket bucket;
+
+                std::string address;
+
+                std::chrono::steady_clock::time_point window_start;
+
+                unsigned long long window_bytes;
+
+                double current_rate;
+            };
+
+            struct stream {
+                boost::shared_ptr<client> owner;
+
+                token_bucket bucket;
+            };
+
+            class waiter {
+            public:
+                virtual void resume() = 0;
+
+            protected:
+                virtual ~waiter() {}
+            };
+
+            bandwidth_shaper(boost::asio::io_context &io_context, unsigned long long client_rate,
+                             unsigned long long connection_rate);
+
+            ~bandwidth_shaper();
+
+            void attach(stream &s, const boost::asio::ip::address &address);
+
+            std::size_t acquire(stream &s, std::size_t wanted);
+
+            void consume(stream &s, std::size_t bytes);
+
+            void wait(stream &s, std::size_t wanted, const boost::shared_ptr<waiter> &w);
+
+        private:
+            typedef boost::unordered_map<std::string, boost::weak_ptr<client> > client_map;
+
+            void handle_tick(const boost::system::error_code &e);
+
+            void arm();
+
+            void render(std::string &out);
+
+            unsigned long long client_rate_;
+
+            unsigned long long connection_rate_;
+
+            boost::mutex mutex_;
+
+            client_map clients_;
+
+            std::size_t sweep_at_;
+
+            std::vector<std::vector<boost::shared_ptr<waiter> > > slots_;
+
+            std::size_t cursor_;
+
+            std::chrono::steady_clock::time_point cursor_time_;
+
+            std::size_t waiting_;
+
+            bool armed_;
+
+            boost::asio::steady_timer timer_;
+
+            std::size_t collector_;
+        };
+
+    }
+}
+
+#endif
@@ -0,0 +1,220 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+#include "http_date.hpp"
+#include "httputils.h"
+#include "mime_types.hpp"
+#include "range.h"
+#include "reply.hpp"
+#include "request.hpp"
+#include "request_handler.hpp"
+#include "request_parser.hpp"
+
+using namespace http::server3;
+
+namespace {
+
+    const char *const request_corpus[] = {
+            "GET /big.bin HTTP/1.1\r\n"
+            "Host: localhost:8080\r\n"
+            "User-Agent: curl/7.88.1\r\n"
+            "Accept: */*\r\n"
+            "\r\n",
+
+            "GET /videos/holiday%202019/clip.mp4 HTTP/1.1\r\n"
+            "Host: files.example.com\r\n"
+            "Connection: keep-alive\r\n"
+            "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+            "sec-ch-ua-mobile: ?0\r\n"
+            "sec-ch-ua-platform: \"Linux\"\r\n"
+            "Upgrade-Insecure-Requests: 1\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+            "Chrome/118.0.0.0 Safari/537.36\r\n"
+            "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+            "image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+            "Sec-Fetch-Site: none\r\n"
+            "Sec-Fetch-Mode: navigate\r\n"
+            "Sec-Fetch-User: ?1\r\n"
+            "Sec-Fetch-Dest: document\r\n"
+            "Accept-Encoding: gzip, deflate, br\r\n"
+            "Accept-Language: en-US,en;q=0.9,de;q=0.8\r\n"
+            "Cookie: session=6f1c2a9e0b7d4c3a8e5f1d2c3b4a5968; theme=dark; consent=1\r\n"
+            "Range: bytes=1048576-\r\n"
+            "If-Range: Tue, 14 Nov 2023 22:13:20 GMT\r\n"
+            "\r\n",
+
+            "GET /downloads/release-1.2.3.tar.gz HTTP/1.1\r\n"
+            "Host: cdn-origin.example.net\r\n"
+            "Via: 1.1 edge-cache-17\r\n"
+            "X-Forwarded-For: 203.0.113.7, 198.51.100.23\r\n"
+            "Accept-Encoding: identity\r\n"
+            "Range: bytes=0-65535,131072-196607\r\n"
+            "If-None-Match: \"release-1.2.3\"\r\n"
+            "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+            "\r\n"
+    };
+
+    void BM_request_parser_parse(benchmark::State &state) {
+        std::string corpus = request_corpus[state.range(0)];
+        std::vector<char> buffer(corpus.begin(), corpus.end());
+        request_parser parser;
+        for (auto _ : state) {
+            request req;
+            parser.reset();
+            benchmark::DoNotOptimize(parser.parse(req, buffer.data(), buffer.data() + buffer.size()));
+            benchmark::DoNotOptimize(req.headers.size());
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<long long>(buffer.size()));
+    }
+
+    BENCHMARK(BM_request_parser_parse)->DenseRange(0, 2);
+
+    void BM_range_parse(benchmark::State &state) {
+        std::string header = "bytes=";
+        for (long i = 0; i < state.range(0); ++i) {
+            if (i > 0)
+                header += ",";
+            long start = (state.range(0) - i) * 4096;
+            header += std::to_string(start) + "-" + std::to_string(start + 1023);
+        }
+        std::vector<range> ranges;
+        for (auto _ : state) {
+            ranges.clear();
+            benchmark::DoNotOptimize(range::parse(header, 1024L * 1024 * 1024, ranges));
+        }
+    }
+
+    BENCHMARK(BM_range_parse)->Arg(1)->Arg(2)->Arg(10)->Arg(100);
+
+    void BM_extension_to_type(benchmark::State &state) {
+        const char *const extensions[] = {"mp4", "html", "XSN", "zip", "unknownext"};
+        const char *extension = extensions[state.range(0)];
+        for (auto _ : state)
+            benchmark::DoNotOptimize(mime_types::extension_to_type(extension));
+    }
+
+    BENCHMARK(BM_extension_to_type)->DenseRange(0, 4);
+
+    void BM_accepts(benchmark::State &state) {
+        boost::string_view accept = "text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,"
+                                    "image/webp,image/apng,*/*;q=0.8";
+        for (auto _ : state)
+            benchmark::DoNotOptimize(httputils::accepts(accept, "video/mp4"));
+    }
+
+    BENCHMARK(BM_accepts);
+
+    void BM_matches(benchmark::State &state) {
+        boost::string_view if_none_match = "\"a1b2c3\", W/\"d4e5f6\", \"9f86d081884c7d65\"";
+        for (auto _ : state)
+            benchmark::DoNotOptimize(httputils::matches(if_none_match, "\"9f86d081884c7d65\"", true));
+    }
+
+    BENCHMARK(BM_matches);
+
+    void BM_encoding_quality(benchmark::State &state) {
+        boost::string_view accept_encoding = "gzip;q=0.8, deflate, br;q=1.0, *;q=0.1";
+        for (auto _ : state)
+            benchmark::DoNotOptimize(httputils::encodingQuality(accept_encoding, "br"));
+    }
+
+    BENCHMARK(BM_encoding_quality);
+
+    void BM_http_date_parse(benchmark::State &state) {
+        const char *const dates[] = {
+                "Sun, 06 Nov 1994 08:49:37 GMT", "Sunday, 06-Nov-94 08:49:37 GMT", "Sun Nov  6 08:49:37 1994"
+        };
+        const char *date = dates[state.range(0)];
+        long long seconds;
+        for (auto _ : state)
+            benchmark::DoNotOptimize(http_date::parse(date, seconds));
+    }
+
+    BENCHMARK(BM_http_date_parse)->DenseRange(0, 2);
+
+    void BM_http_date_format(benchmark::State &state) {
+        char out[http_date::length];
+        long long seconds = 1700000000;
+        for (auto _ : state) {
+            http_date::format(seconds++, out);
+            benchmark::DoNotOptimize(out);
+        }
+    }
+
+    BENCHMARK(BM_http_date_format);
+
+    void BM_reply_to_buffers(benchmark::State &state) {
+        reply rep;
+        rep.status = reply::partial_content;
+        const char *const names[] = {
+                "Content-Type", "Content-Disposition", "Accept-Ranges", "ETag", "Last-Modified", "Expires",
+                "Content-Range", "Content-Length", "Date", "Connection"
+        };
+        for (const char *name : names) {
+            header h;
+            h.name = name;
+            h.value = "value of a typical response header";
+            rep.headers.push_back(h);
+        }
+        rep.content.assign(static_cast<std::size_t>(state.range(0)), 'x');
+        for (auto _ : state)
+            benchmark::DoNotOptimize(rep.to_buffers());
+    }
+
+    BENCHMARK(BM_reply_to_buffers)->Arg(0)->Arg(4096);
+
+    class doc_root {
+    public:
+        doc_root() {
+            const char *base = access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+            path_ = boost::filesystem::path(base) / boost::filesystem::unique_path("bench-%%%%-%%%%");
+            boost::filesystem::create_directories(path_);
+            std::string data(8 * 1024 * 1024, 'x');
+            std::FILE *file = std::fopen((path_ / "data.bin").c_str(), "wb");
+            std::fwrite(data.data(), 1, data.size(), file);
+            std::fclose(file);
+        }
+
+        ~doc_root() {
+            boost::system::error_code ignored_ec;
+            boost::filesystem::remove_all(path_, ignored_ec);
+        }
+
+        std::string path() const {
+            return path_.string();
+        }
+
+    private:
+        boost::filesystem::path path_;
+    };
+
+    void BM_handle_request(benchmark::State &state) {
+        static doc_root root;
+        static request_handler handler(root.path());
+
+        std::string raw = "GET /data.bin HTTP/1.1\r\nHost: localhost\r\n";
+        if (state.range(0) == 1)
+            raw += "Range: bytes=0-65535\r\n";
+        else if (state.range(0) == 2)
+            raw += "Range: bytes=0-1023,4096-5119,1048576-1049599\r\n";
+        raw += "\r\n";
+        std::vector<char> buffer(raw.begin(), raw.end());
+        request req;
+        request_parser parser;
+        parser.parse(req, buffer.data(), buffer.data() + buffer.size());
+
+        for (auto _ : state) {
+            reply rep;
+            handler.handle_request(req, rep);
+            benchmark::DoNotOptimize(rep.headers.data());
+        }
+    }
+
+    BENCHMARK(BM_handle_request)->DenseRange(0, 2);
+}
+
+BENCHMARK_MAIN();
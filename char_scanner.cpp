@@ -0,0 +1,144 @@
+#include "char_scanner.hpp"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HTTP_SERVER3_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace http {
+    namespace server3 {
+        namespace char_scanner {
+
+            namespace {
+
+                struct char_table {
+                    char_table() {
+                        std::memset(token, 0, sizeof(token));
+                        const char tspecials[] = "()<>@,;:\\\"/[]?={} \t";
+                        for (int c = 33; c < 127; ++c)
+                            token[c] = std::strchr(tspecials, c) == 0;
+                    }
+
+                    bool token[256];
+                };
+
+                const char_table table;
+
+                inline bool stops_at(unsigned char c, unsigned char last_ctl) {
+                    return c <= last_ctl || c == 0x7f;
+                }
+
+                const char *find_token_end_scalar(const char *begin, const char *end) {
+                    while (begin != end && table.token[static_cast<unsigned char>(*begin)])
+                        ++begin;
+                    return begin;
+                }
+
+                const char *find_ctl_scalar(const char *begin, const char *end, unsigned char last_ctl) {
+                    while (begin != end && !stops_at(static_cast<unsigned char>(*begin), last_ctl))
+                        ++begin;
+                    return begin;
+                }
+
+#if defined(HTTP_SERVER3_X86_SIMD)
+
+                const char *find_ctl_sse2(const char *begin, const char *end, unsigned char last_ctl) {
+                    const __m128i limit = _mm_set1_epi8(static_cast<char>(last_ctl));
+                    const __m128i del = _mm_set1_epi8(0x7f);
+                    while (end - begin >= 16) {
+                        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+                        __m128i low = _mm_cmpeq_epi8(_mm_max_epu8(v, limit), limit);
+                        int mask = _mm_movemask_epi8(_mm_or_si128(low, _mm_cmpeq_epi8(v, del)));
+                        if (mask)
+                            return begin + __builtin_ctz(static_cast<unsigned int>(mask));
+                        begin += 16;
+                    }
+                    return find_ctl_scalar(begin, end, last_ctl);
+                }
+
+                __attribute__((target("avx2")))
+                const char *find_ctl_avx2(const char *begin, const char *end, unsigned char last_ctl) {
+                    const __m256i limit = _mm256_set1_epi8(static_cast<char>(last_ctl));
+                    const __m256i del = _mm256_set1_epi8(0x7f);
+                    while (end - begin >= 32) {
+                        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+                        __m256i low = _mm256_cmpeq_epi8(_mm256_max_epu8(v, limit), limit);
+                        int mask = _mm256_movemask_epi8(_mm256_or_si256(low, _mm256_cmpeq_epi8(v, del)));
+                        if (mask)
+                            return begin + __builtin_ctz(static_cast<unsigned int>(mask));
+                        begin += 32;
+                    }
+                    return find_ctl_sse2(begin, end, last_ctl);
+                }
+
+                // PCMPESTRI range mode allows eight ranges, so "{" to "\xff" also
+                // catches '|' and '~'; those two are re-checked against the table.
+                __attribute__((target("sse4.2")))
+                const char *find_token_end_sse42(const char *begin, const char *end) {
+                    static const char ranges[16] = {
+                            '\x00', ' ', '"', '"', '(', ')', ',', ',', '/', '/', ':', '@', '[', ']', '{', '\xff'
+                    };
+                    const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ranges));
+                    while (end - begin >= 16) {
+                        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+                        int index = _mm_cmpestri(r, 16, v, 16,
+                                                 _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+                        if (index != 16) {
+                            begin += index;
+                            if (!table.token[static_cast<unsigned char>(*begin)])
+                                return begin;
+                            ++begin;
+                            continue;
+                        }
+                        begin += 16;
+                    }
+                    return find_token_end_scalar(begin, end);
+                }
+
+                struct dispatch {
+                    dispatch() {
+                        __builtin_cpu_init();
+                        find_ctl = __builtin_cpu_supports("avx2") ? &find_ctl_avx2 : &find_ctl_sse2;
+                        find_token = __builtin_cpu_supports("sse4.2") ? &find_token_end_sse42
+                                                                       : &find_token_end_scalar;
+                    }
+
+                    const char *(*find_ctl)(const char *, const char *, unsigned char);
+
+                    const char *(*find_token)(const char *, const char *);
+                };
+
+#else
+
+                struct dispatch {
+                    dispatch() : find_ctl(&find_ctl_scalar), find_token(&find_token_end_scalar) {}
+
+                    const char *(*find_ctl)(const char *, const char *, unsigned char);
+
+                    const char *(*find_token)(const char *, const char *);
+                };
+
+#endif
+
+                const dispatch &implementation() {
+                    static const dispatch d;
+                    return d;
+                }
+            }
+
+            const char *find_token_end(const char *begin, const char *end) {
+                return implementation().find_token(begin, end);
+            }
+
+            const char *find_uri_end(const char *begin, const char *end) {
+                return implementation().find_ctl(begin, end, ' ');
+            }
+
+            const char *find_value_end(const char *begin, const char *end) {
+                return implementation().find_ctl(begin, end, 0x1f);
+            }
+
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef HTTP_SERVER3_CHAR_SCANNER_HPP
+#define HTTP_SERVER3_CHAR_SCANNER_HPP
+
+namespace http {
+    namespace server3 {
+        namespace char_scanner {
+
+            const char *find_token_end(const char *begin, const char *end);
+
+            const char *find_uri_end(const char *begin, const char *end);
+
+            const char *find_value_end(const char *begin, const char *end);
+
+        }
+    }
+}
+
+#endif
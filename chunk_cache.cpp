@@ -0,0 +1,278 @@
+#include "chunk_cache.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <iterator>
+#include <boost/asio/post.hpp>
+#include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace http {
+    namespace server3 {
+
+        namespace {
+            const unsigned int max_frequency = 15;
+
+            const boost::uint64_t sketch_seeds[] = {
+                    0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL
+            };
+
+            std::size_t next_power_of_two(std::size_t value) {
+                std::size_t result = 1;
+                while (result < value)
+                    result <<= 1;
+                return result;
+            }
+        }
+
+        std::size_t chunk_cache::key_hash::operator()(const key &k) const {
+            std::size_t seed = 0;
+            boost::hash_combine(seed, k.device);
+            boost::hash_combine(seed, k.inode);
+            boost::hash_combine(seed, k.modification_ms);
+            boost::hash_combine(seed, k.index);
+            return seed;
+        }
+
+        chunk_cache::frequency_sketch::frequency_sketch(std::size_t width)
+                : counters_(depth * next_power_of_two(std::max<std::size_t>(width, 16)), 0),
+                  mask_(next_power_of_two(std::max<std::size_t>(width, 16)) - 1),
+                  additions_(0),
+                  sample_size_(10 * (mask_ + 1)) {
+        }
+
+        std::size_t chunk_cache::frequency_sketch::index_of(std::size_t hash, int row) const {
+            boost::uint64_t x = (static_cast<boost::uint64_t>(hash) + sketch_seeds[row]) * 0x9e3779b97f4a7c15ULL;
+            x ^= x >> 32;
+            return row * (mask_ + 1) + (static_cast<std::size_t>(x) & mask_);
+        }
+
+        void chunk_cache::frequency_sketch::increment(std::size_t hash) {
+            for (int row = 0; row < depth; ++row) {
+                boost::uint8_t &counter = counters_[index_of(hash, row)];
+                if (counter < max_frequency)
+                    ++counter;
+            }
+
+            if (++additions_ >= sample_size_) {
+                for (std::size_t i = 0; i < counters_.size(); ++i)
+                    counters_[i] >>= 1;
+                additions_ /= 2;
+            }
+        }
+
+        unsigned int chunk_cache::frequency_sketch::estimate(std::size_t hash) const {
+            unsigned int result = max_frequency;
+            for (int row = 0; row < depth; ++row)
+                result = std::min<unsigned int>(result, counters_[index_of(hash, row)]);
+            return result;
+        }
+
+        chunk_cache::shard::shard(std::size_t capacity)
+                : window_bytes(0),
+                  probation_bytes(0),
+                  protected_bytes(0),
+                  window_capacity(std::max<std::size_t>(capacity / 100, chunk_size)),
+                  main_capacity(capacity > window_capacity ? capacity - window_capacity : 0),
+                  protected_capacity(main_capacity / 5 * 4),
+                  sketch(capacity / chunk_size) {
+        }
+
+        chunk_cache::chunk_cache(std::size_t capacity_bytes)
+                : hits_(0),
+                  misses_(0),
+                  evictions_(0),
+                  rejections_(0),
+                  pool_(1) {
+            for (std::size_t i = 0; i < shard_count; ++i)
+                shards_.push_back(boost::shared_ptr<shard>(new shard(capacity_bytes / shard_count)));
+        }
+
+        chunk_cache::~chunk_cache() {
+            pool_.stop();
+            pool_.join();
+        }
+
+        chunk_ptr chunk_cache::find(const cached_file &file, unsigned long long index) {
+            key k = make_key(file, index);
+            std::size_t hash = key_hash()(k);
+            shard &s = *shards_[hash % shard_count];
+            boost::lock_guard<boost::mutex> lock(s.mutex);
+            s.sketch.increment(hash);
+            boost::unordered_map<key, node_list::iterator, key_hash>::iterator it = s.index.find(k);
+            if (it == s.index.end()) {
+                misses_.fetch_add(1, std::memory_order_relaxed);
+                return chunk_ptr();
+            }
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            chunk_ptr data = it->second->data;
+            on_hit(s, it->second);
+            return data;
+        }
+
+        void chunk_cache::prefetch(const cached_file_ptr &file, unsigned long long index) {
+            key k = make_key(*file, index);
+            std::size_t hash = key_hash()(k);
+            {
+                shard &s = *shards_[hash % shard_count];
+                boost::lock_guard<boost::mutex> lock(s.mutex);
+                if (s.sketch.estimate(hash) < 2 || s.index.find(k) != s.index.end())
+                    return;
+            }
+            {
+                boost::lock_guard<boost::mutex> lock(pending_mutex_);
+                if (pending_.size() >= max_pending || !pending_.insert(k).second)
+                    return;
+            }
+            boost::asio::post(pool_, boost::bind(&chunk_cache::fill, this, file, index));
+        }
+
+        void chunk_cache::fill(const cached_file_ptr &file, unsigned long long index) {
+            chunk_ptr data = read_chunk(*file, index);
+            if (data)
+                offer(*file, index, data);
+            boost::lock_guard<boost::mutex> lock(pending_mutex_);
+            pending_.erase(make_key(*file, index));
+        }
+
+        void chunk_cache::offer(const cached_file &file, unsigned long long index, const chunk_ptr &data) {
+            key k = make_key(file, index);
+            std::size_t hash = key_hash()(k);
+            shard &s = *shards_[hash % shard_count];
+            boost::lock_guard<boost::mutex> lock(s.mutex);
+            if (s.index.find(k) == s.index.end())
+                insert(s, k, hash, data);
+        }
+
+        void chunk_cache::invalidate(const cached_file &file) {
+            for (unsigned long long index = 0; index * chunk_size < file.size; ++index) {
+                key k = make_key(file, index);
+                shard &s = *shards_[key_hash()(k) % shard_count];
+                boost::lock_guard<boost::mutex> lock(s.mutex);
+                boost::unordered_map<key, node_list::iterator, key_hash>::iterator it = s.index.find(k);
+                if (it != s.index.end()) {
+                    node_list::iterator node = it->second;
+                    evict(s, list_for(s, node->where), node);
+                }
+            }
+        }
+
+        std::size_t chunk_cache::size_bytes() const {
+            std::size_t total = 0;
+            for (std::size_t i = 0; i < shards_.size(); ++i) {
+                boost::lock_guard<boost::mutex> lock(shards_[i]->mutex);
+                total += shards_[i]->window_bytes + shards_[i]->probation_bytes + shards_[i]->protected_bytes;
+            }
+            return total;
+        }
+
+        chunk_cache::key chunk_cache::make_key(const cached_file &file, unsigned long long index) {
+            key k = {file.device, file.inode, file.modification_ms, index};
+            return k;
+        }
+
+        chunk_ptr chunk_cache::read_chunk(const cached_file &file, unsigned long long index) const {
+            unsigned long long offset = index * chunk_size;
+            if (offset >= file.size)
+                return chunk_ptr();
+
+            std::size_t length = std::min<unsigned long long>(chunk_size, file.size - offset);
+            boost::shared_ptr<std::string> data(new std::string(length, '\0'));
+            std::size_t done = 0;
+            while (done < length) {
+                ssize_t n = ::pread(file.file->native_handle(), &(*data)[done], length - done, offset + done);
+                if (n <= 0)
+                    return chunk_ptr();
+                done += n;
+            }
+            return data;
+        }
+
+        void chunk_cache::on_hit(shard &s, node_list::iterator it) {
+            switch (it->where) {
+                case window:
+                    s.window_list.splice(s.window_list.begin(), s.window_list, it);
+                    break;
+                case probation:
+                    s.probation_bytes -= it->data->size();
+                    s.protected_bytes += it->data->size();
+                    it->where = protected_segment;
+                    s.protected_list.splice(s.protected_list.begin(), s.probation_list, it);
+                    while (s.protected_bytes > s.protected_capacity && s.protected_list.size() > 1) {
+                        node_list::iterator demoted = std::prev(s.protected_list.end());
+                        s.protected_bytes -= demoted->data->size();
+                        s.probation_bytes += demoted->data->size();
+                        demoted->where = probation;
+                        s.probation_list.splice(s.probation_list.begin(), s.protected_list, demoted);
+                    }
+                    break;
+                case protected_segment:
+                    s.protected_list.splice(s.protected_list.begin(), s.protected_list, it);
+                    break;
+            }
+        }
+
+        void chunk_cache::insert(shard &s, const key &k, std::size_t hash, const chunk_ptr &data) {
+            node n = {k, data, window};
+            s.window_list.push_front(n);
+            s.index[k] = s.window_list.begin();
+            s.window_bytes += data->size();
+
+            while (s.window_bytes > s.window_capacity) {
+                node_list::iterator candidate = std::prev(s.window_list.end());
+                std::size_t candidate_size = candidate->data->size();
+
+                if (s.probation_bytes + s.protected_bytes + candidate_size <= s.main_capacity) {
+                    s.window_bytes -= candidate_size;
+                    s.probation_bytes += candidate_size;
+                    candidate->where = probation;
+                    s.probation_list.splice(s.probation_list.begin(), s.window_list, candidate);
+                    continue;
+                }
+
+                node_list &victims = s.probation_list.empty() ? s.protected_list : s.probation_list;
+                if (!victims.empty()) {
+                    node_list::iterator victim = std::prev(victims.end());
+                    std::size_t candidate_hash = candidate->k == k ? hash : key_hash()(candidate->k);
+                    if (s.sketch.estimate(candidate_hash) > s.sketch.estimate(key_hash()(victim->k))) {
+                        evict(s, victims, victim);
+                        evictions_.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                }
+
+                evict(s, s.window_list, candidate);
+                rejections_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        void chunk_cache::evict(shard &s, node_list &list, node_list::iterator it) {
+            bytes_for(s, it->where) -= it->data->size();
+            s.index.erase(it->k);
+            list.erase(it);
+        }
+
+        std::size_t &chunk_cache::bytes_for(shard &s, segment where) {
+            switch (where) {
+                case window:
+                    return s.window_bytes;
+                case probation:
+                    return s.probation_bytes;
+                default:
+                    return s.protected_bytes;
+            }
+        }
+
+        chunk_cache::node_list &chunk_cache::list_for(shard &s, segment where) {
+            switch (where) {
+                case window:
+                    return s.window_list;
+                case probation:
+                    return s.probation_list;
+                default:
+                    return s.protected_list;
+            }
+        }
+
+    }
+}
@@ -0,0 +1,158 @@
+#ifndef HTTP_SERVER3_CHUNK_CACHE_HPP
+#define HTTP_SERVER3_CHUNK_CACHE_HPP
+
+#include <atomic>
+#include <list>
+#include <string>
+#include <vector>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include "file_cache.hpp"
+
+namespace http {
+    namespace server3 {
+
+        typedef boost::shared_ptr<const std::string> chunk_ptr;
+
+        class chunk_cache : private boost::noncopyable {
+        public:
+            static const std::size_t chunk_size = 256 * 1024;
+
+            static const unsigned long long max_cached_range = 4 * 1024 * 1024;
+
+            explicit chunk_cache(std::size_t capacity_bytes = 256 * 1024 * 1024);
+
+            ~chunk_cache();
+
+            chunk_ptr find(const cached_file &file, unsigned long long index);
+
+            void prefetch(const cached_file_ptr &file, unsigned long long index);
+
+            void offer(const cached_file &file, unsigned long long index, const chunk_ptr &data);
+
+            void invalidate(const cached_file &file);
+
+            unsigned long long hits() const { return hits_.load(std::memory_order_relaxed); }
+
+            unsigned long long misses() const { return misses_.load(std::memory_order_relaxed); }
+
+            unsigned long long evictions() const { return evictions_.load(std::memory_order_relaxed); }
+
+            unsigned long long rejections() const { return rejections_.load(std::memory_order_relaxed); }
+
+            std::size_t size_bytes() const;
+
+        private:
+            struct key {
+                dev_t device;
+                ino_t inode;
+                long long int modification_ms;
+                unsigned long long index;
+
+                bool operator==(const key &other) const {
+                    return index == other.index && inode == other.inode && device == other.device
+                           && modification_ms == other.modification_ms;
+                }
+            };
+
+            struct key_hash {
+                std::size_t operator()(const key &k) const;
+            };
+
+            class frequency_sketch {
+            public:
+                explicit frequency_sketch(std::size_t width);
+
+                void increment(std::size_t hash);
+
+                unsigned int estimate(std::size_t hash) const;
+
+            private:
+                static const int depth = 4;
+
+                std::size_t index_of(std::size_t hash, int row) const;
+
+                std::vector<boost::uint8_t> counters_;
+
+                std::size_t mask_;
+
+                std::size_t additions_;
+
+                std::size_t sample_size_;
+            };
+
+            enum segment {
+                window, probation, protected_segment
+            };
+
+            struct node {
+                key k;
+                chunk_ptr data;
+                segment where;
+            };
+
+            typedef std::list<node> node_list;
+
+            struct shard {
+                explicit shard(std::size_t capacity);
+
+                boost::mutex mutex;
+                boost::unordered_map<key, node_list::iterator, key_hash> index;
+                node_list window_list;
+                node_list probation_list;
+                node_list protected_list;
+                std::size_t window_bytes;
+                std::size_t probation_bytes;
+                std::size_t protected_bytes;
+                std::size_t window_capacity;
+                std::size_t main_capacity;
+                std::size_t protected_capacity;
+                frequency_sketch sketch;
+            };
+
+            static const std::size_t shard_count = 16;
+
+            static const std::size_t max_pending = 64;
+
+            static key make_key(const cached_file &file, unsigned long long index);
+
+            chunk_ptr read_chunk(const cached_file &file, unsigned long long index) const;
+
+            void fill(const cached_file_ptr &file, unsigned long long index);
+
+            void on_hit(shard &s, node_list::iterator it);
+
+            void insert(shard &s, const key &k, std::size_t hash, const chunk_ptr &data);
+
+            void evict(shard &s, node_list &list, node_list::iterator it);
+
+            std::size_t &bytes_for(shard &s, segment where);
+
+            static node_list &list_for(shard &s, segment where);
+
+            std::vector<boost::shared_ptr<shard> > shards_;
+
+            std::atomic<unsigned long long> hits_;
+
+            std::atomic<unsigned long long> misses_;
+
+            std::atomic<unsigned long long> evictions_;
+
+            std::atomic<unsigned long long> rejections_;
+
+            boost::mutex pending_mutex_;
+
+            boost::unordered_set<key, key_hash> pending_;
+
+            boost::asio::thread_pool pool_;
+        };
+
+    }
+}
+
+#endif
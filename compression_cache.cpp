@@ -0,0 +1,201 @@
+#include "compression_cache.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <boost/asio/post.hpp>
+#include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/locks.hpp>
+#include "mime_types.hpp"
+
+namespace http {
+    namespace server3 {
+
+        namespace {
+            const std::size_t max_entries = 4096;
+
+            const std::size_t block_size = 64 * 1024;
+
+            int create_anonymous_file() {
+#if defined(__linux__)
+                return ::memfd_create("compressed", MFD_CLOEXEC);
+#else
+                char name[] = "/tmp/compressedXXXXXX";
+                int fd = ::mkstemp(name);
+                if (fd >= 0)
+                    ::unlink(name);
+                return fd;
+#endif
+            }
+
+            bool write_all(int fd, const unsigned char *data, std::size_t size) {
+                while (size > 0) {
+                    ssize_t n = ::write(fd, data, size);
+                    if (n <= 0)
+                        return false;
+                    data += n;
+                    size -= n;
+                }
+                return true;
+            }
+
+            bool gzip_file(int in, unsigned long long size, int out) {
+                z_stream stream;
+                std::memset(&stream, 0, sizeof(stream));
+                if (deflateInit2(&stream, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                    return false;
+
+                std::vector<unsigned char> input(block_size), output(block_size);
+                unsigned long long offset = 0;
+                bool finishing = false;
+                int result = Z_OK;
+                while (result != Z_STREAM_END) {
+                    if (stream.avail_in == 0 && !finishing) {
+                        std::size_t count = std::min<unsigned long long>(input.size(), size - offset);
+                        ssize_t n = ::pread(in, input.data(), count, offset);
+                        if (n < 0) {
+                            deflateEnd(&stream);
+                            return false;
+                        }
+                        offset += n;
+                        finishing = n == 0 || offset >= size;
+                        stream.next_in = input.data();
+                        stream.avail_in = static_cast<uInt>(n);
+                    }
+
+                    stream.next_out = output.data();
+                    stream.avail_out = static_cast<uInt>(output.size());
+                    result = deflate(&stream, finishing ? Z_FINISH : Z_NO_FLUSH);
+                    if (result == Z_STREAM_ERROR
+                        || !write_all(out, output.data(), output.size() - stream.avail_out)) {
+                        deflateEnd(&stream);
+                        return false;
+                    }
+                }
+                deflateEnd(&stream);
+                return true;
+            }
+        }
+
+        std::size_t compression_cache::key_hash::operator()(const key &k) const {
+            std::size_t seed = 0;
+            boost::hash_combine(seed, k.device);
+            boost::hash_combine(seed, k.inode);
+            boost::hash_combine(seed, k.modification_ms);
+            return seed;
+        }
+
+        compression_cache::compression_cache(chunk_cache &chunks, std::size_t capacity_bytes,
+                                             unsigned long long max_file_size)
+                : chunks_(chunks),
+                  capacity_bytes_(capacity_bytes),
+                  max_file_size_(max_file_size),
+                  size_bytes_(0),
+                  pool_(1) {
+        }
+
+        compression_cache::~compression_cache() {
+            pool_.stop();
+            pool_.join();
+        }
+
+        bool compression_cache::eligible(const cached_file &file) const {
+            return file.size > 0 && file.size <= max_file_size_ && mime_types::is_compressible(file.content_type);
+        }
+
+        cached_file_ptr compression_cache::find_gzip(const cached_file_ptr &file) {
+            key k = {file->device, file->inode, file->modification_ms};
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            boost::unordered_map<key, entry, key_hash>::iterator it = entries_.find(k);
+            if (it != entries_.end()) {
+                if (!it->second.pending)
+                    recency_.splice(recency_.begin(), recency_, it->second.position);
+                return it->second.variant;
+            }
+
+            entry pending;
+            pending.pending = true;
+            pending.position = recency_.end();
+            entries_.emplace(k, pending);
+            boost::asio::post(pool_, boost::bind(&compression_cache::compress, this, file, k));
+            return cached_file_ptr();
+        }
+
+        cached_file_ptr compression_cache::invalidate(const cached_file &file) {
+            key k = {file.device, file.inode, file.modification_ms};
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            boost::unordered_map<key, entry, key_hash>::iterator it = entries_.find(k);
+            if (it == entries_.end() || it->second.pending)
+                return cached_file_ptr();
+
+            cached_file_ptr variant = it->second.variant;
+            if (variant)
+                size_bytes_ -= variant->size;
+            recency_.erase(it->second.position);
+            entries_.erase(it);
+            return variant;
+        }
+
+        void compression_cache::compress(const cached_file_ptr &file, const key &k) {
+            int fd = create_anonymous_file();
+            if (fd < 0) {
+                store(k, cached_file_ptr(), 0);
+                return;
+            }
+            file_descriptor_ptr compressed(new file_descriptor(fd));
+
+            struct stat info;
+            if (!gzip_file(file->file->native_handle(), file->size, fd) || ::fstat(fd, &info) != 0
+                || static_cast<unsigned long long>(info.st_size) * 10 >= file->size * 9) {
+                store(k, cached_file_ptr(), 0);
+                return;
+            }
+
+            boost::shared_ptr<cached_file> variant(new cached_file());
+            variant->file = compressed;
+            variant->size = info.st_size;
+            variant->modification_ms = file->modification_ms;
+            variant->device = info.st_dev;
+            variant->inode = info.st_ino;
+            variant->content_type = file->content_type;
+            variant->validated = file->validated;
+            store(k, variant, variant->size);
+        }
+
+        void compression_cache::store(const key &k, const cached_file_ptr &variant, std::size_t size) {
+            std::vector<cached_file_ptr> evicted;
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                boost::unordered_map<key, entry, key_hash>::iterator it = entries_.find(k);
+                if (it == entries_.end())
+                    return;
+
+                it->second.variant = variant;
+                it->second.pending = false;
+                recency_.push_front(k);
+                it->second.position = recency_.begin();
+                size_bytes_ += size;
+
+                while ((size_bytes_ > capacity_bytes_ || entries_.size() > max_entries) && !recency_.empty()) {
+                    boost::unordered_map<key, entry, key_hash>::iterator victim = entries_.find(recency_.back());
+                    if (victim->second.variant) {
+                        size_bytes_ -= victim->second.variant->size;
+                        evicted.push_back(victim->second.variant);
+                    }
+                    entries_.erase(victim);
+                    recency_.pop_back();
+                }
+            }
+
+            for (const cached_file_ptr &file : evicted)
+                chunks_.invalidate(*file);
+        }
+
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef HTTP_SERVER3_COMPRESSION_CACHE_HPP
+#define HTTP_SERVER3_COMPRESSION_CACHE_HPP
+
+#include <list>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include "chunk_cache.hpp"
+#include "file_cache.hpp"
+
+namespace http {
+    namespace server3 {
+
+        class compression_cache : private boost::noncopyable {
+        public:
+            explicit compression_cache(chunk_cache &chunks, std::size_t capacity_bytes = 64 * 1024 * 1024,
+                                       unsigned long long max_file_size = 8 * 1024 * 1024);
+
+            ~compression_cache();
+
+            bool eligible(const cached_file &file) const;
+
+            cached_file_ptr find_gzip(const cached_file_ptr &file);
+
+            cached_file_ptr invalidate(const cached_file &file);
+
+        private:
+            struct key {
+                dev_t device;
+                ino_t inode;
+                long long int modification_ms;
+
+                bool operator==(const key &other) const {
+                    return inode == other.inode && device == other.device
+                           && modification_ms == other.modification_ms;
+                }
+            };
+
+            struct key_hash {
+                std::size_t operator()(const key &k) const;
+            };
+
+            struct entry {
+                cached_file_ptr variant;
+                bool pending;
+                std::list<key>::iterator position;
+            };
+
+            void compress(const cached_file_ptr &file, const key &k);
+
+            void store(const key &k, const cached_file_ptr &variant, std::size_t size);
+
+            chunk_cache &chunks_;
+
+            std::size_t capacity_bytes_;
+
+            unsigned long long max_file_size_;
+
+            boost::mutex mutex_;
+
+            boost::unordered_map<key, entry, key_hash> entries_;
+
+            std::list<key> recency_;
+
+            std::size_t size_bytes_;
+
+            boost::asio::thread_pool pool_;
+        };
+
+    }
+}
+
+#endif
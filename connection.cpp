@@ -1,16 +1,155 @@
 #include "connection.hpp"
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/sendfile.h>
+#endif
+#include <boost/array.hpp>
 #include <boost/bind.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/find.hpp>
 #include "request_handler.hpp"
+#include "io_uring_service.hpp"
+#include "http_date.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
 
 namespace http {
     namespace server3 {
 
+        namespace {
+            const std::size_t send_window = 256 * 1024;
+
+            const std::chrono::seconds request_timeout(15);
+
+            const std::chrono::seconds throughput_interval(10);
+
+            const unsigned long long min_throughput = 4096;
+
+            const std::size_t initial_buffer_size = 8192;
+
+            const std::size_t max_buffer_size = 65536;
+
+            const char header_end[] = {'\r', '\n', '\r', '\n'};
+
+            const char switching_protocols[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\n"
+                                               "Upgrade: h2c\r\n\r\n";
+
+            void rebase(boost::string_view &view, const char *old_base, const char *new_base) {
+                if (view.data())
+                    view = boost::string_view(new_base + (view.data() - old_base), view.size());
+            }
+
+            void rebase(request &req, const char *old_base, const char *new_base) {
+                rebase(req.method, old_base, new_base);
+                rebase(req.uri, old_base, new_base);
+                for (request_header &h : req.headers) {
+                    rebase(h.name, old_base, new_base);
+                    rebase(h.value, old_base, new_base);
+                }
+            }
+
+            bool wants_keep_alive(const request &req) {
+                for (const request_header &h : req.headers) {
+                    if (boost::algorithm::iequals(h.name, "Connection")) {
+                        if (boost::algorithm::ifind_first(h.value, "close"))
+                            return false;
+                        if (boost::algorithm::ifind_first(h.value, "keep-alive"))
+                            return true;
+                    }
+                }
+                return req.http_version_major > 1 || (req.http_version_major == 1 && req.http_version_minor >= 1);
+            }
+
+            boost::string_view header_value(const request &req, boost::string_view name) {
+                for (const request_header &h : req.headers) {
+                    if (boost::algorithm::iequals(h.name, name))
+                        return h.value;
+                }
+                return boost::string_view();
+            }
+
+            bool parse_content_length(boost::string_view value, unsigned long long &length) {
+                length = 0;
+                if (value.empty())
+                    return false;
+                for (char c : value) {
+                    if (c < '0' || c > '9' || length > (~0ULL - 9) / 10)
+                        return false;
+                    length = length * 10 + (c - '0');
+                }
+                return true;
+            }
+
+            void drop_body(reply &rep) {
+                rep.content.clear();
+                rep.body_file.reset();
+                rep.body_offset = rep.body_length = 0;
+                rep.body_chunks.clear();
+                rep.body_buffers.clear();
+                rep.body_segments.clear();
+            }
+        }
+
         connection::connection(boost::asio::io_context &io_context,
-                               request_handler &handler)
-                : strand_(io_context),
+                               request_handler &handler,
+                               io_uring_service *io_uring,
+                               bool single_threaded,
+                               bandwidth_shaper *shaper,
+                               admission_control *admission,
+                               tls_context *tls,
+                               bool http2)
+                : executor_(single_threaded
+                            ? boost::asio::any_io_executor(io_context.get_executor())
+                            : boost::asio::any_io_executor(boost::asio::make_strand(io_context))),
                   socket_(io_context),
-                  request_handler_(handler) {
+                  watchdog_(executor_),
+                  request_handler_(handler),
+                  io_uring_(io_uring),
+                  shaper_(shaper),
+                  shaped_(false),
+                  admission_(admission),
+                  first_request_(false),
+                  tls_context_(tls),
+                  http2_enabled_(http2),
+                  http2_reading_(false),
+                  http2_writing_(false),
+                  http2_throttled_(false),
+                  buffer_(initial_buffer_size),
+                  keep_alive_(false),
+                  request_body_left_(0),
+                  body_bytes_(0),
+                  response_bytes_(0),
+                  sent_bytes_(0),
+                  watchdog_sent_(0),
+                  writing_(false),
+                  next_segment_(0),
+                  next_memory_(0),
+                  memory_head_(0),
+                  parse_time_(0),
+                  started_(false)
+#if defined(__linux__)
+                  , body_chunk_start_(0),
+                  body_read_(0),
+                  watching_peer_(false)
+#endif
+        {
+            buffer_begin_ = buffer_end_ = request_begin_ = buffer_.data();
+        }
+
+        connection::~connection() {
+            end_response();
+            if (started_) {
+                metrics::connection_closed();
+                if (admission_)
+                    admission_->connection_closed();
+            }
         }
 
         boost::asio::ip::tcp::socket &connection::socket() {
@@ -18,51 +157,792 @@ namespace http {
         }
 
         void connection::start() {
-            socket_.async_read_some(boost::asio::buffer(buffer_),
-                                    boost::asio::bind_executor(strand_,
-                                                               boost::bind(&connection::handle_read, shared_from_this(),
-                                                                           boost::asio::placeholders::error,
-                                                                           boost::asio::placeholders::bytes_transferred)));
+            started_ = true;
+            first_request_ = true;
+            metrics::connection_opened();
+            if (admission_)
+                admission_->connection_opened();
+#if defined(TCP_NOTSENT_LOWAT)
+            int low_watermark = send_window;
+            ::setsockopt(socket_.native_handle(), IPPROTO_TCP, TCP_NOTSENT_LOWAT, &low_watermark,
+                         sizeof(low_watermark));
+#endif
+            if (shaper_) {
+                boost::system::error_code ignored_ec;
+                shaper_->attach(shaping_, socket_.remote_endpoint(ignored_ec).address());
+            }
+            arm_watchdog(request_timeout);
+            if (tls_context_) {
+                try {
+                    tls_.reset(new tls_stream(*tls_context_, socket_));
+                }
+                catch (boost::system::system_error &e) {
+                    HTTP_SERVER3_LOG(warning, "Cannot start a TLS session: " << e.what());
+                    close();
+                    return;
+                }
+                tls_->async_handshake(wrap(boost::bind(&connection::handle_handshake, shared_from_this(),
+                                                       boost::asio::placeholders::error)));
+                return;
+            }
+            read_request();
+        }
+
+        void connection::handle_handshake(const boost::system::error_code &e) {
+            if (e) {
+                if (e != boost::asio::error::operation_aborted) {
+                    HTTP_SERVER3_LOG(debug, "TLS handshake failed: " << e.message());
+                    metrics::record_event(metrics::tls_handshake_failed);
+                }
+                close();
+                return;
+            }
+
+            metrics::record_event(tls_->kernel_send() ? metrics::tls_kernel_offload : metrics::tls_userspace);
+            if (http2_enabled_ && tls_->protocol() == "h2") {
+                start_http2();
+                return;
+            }
+            read_request();
+        }
+
+        void connection::reset() {
+            boost::system::error_code ignored_ec;
+            socket_.close(ignored_ec);
+            end_response();
+            if (started_) {
+                metrics::connection_closed();
+                if (admission_)
+                    admission_->connection_closed();
+            }
+            started_ = false;
+            buffer_begin_ = buffer_end_ = request_begin_ = buffer_.data();
+            keep_alive_ = false;
+            request_body_left_ = 0;
+            request_ = request();
+            request_parser_.reset();
+            reply_ = reply();
+            body_bytes_ = response_bytes_ = sent_bytes_ = watchdog_sent_ = 0;
+            date_.reset();
+            tls_.reset();
+            http2_.reset();
+            http2_output_ = http2_session::output();
+            http2_reading_ = http2_writing_ = http2_throttled_ = false;
+            next_segment_ = 0;
+            memory_.clear();
+            next_memory_ = memory_head_ = 0;
+            parse_time_ = std::chrono::steady_clock::duration::zero();
+            shaping_.owner.reset();
+            shaped_ = false;
+#if defined(__linux__)
+            body_chunk_.reset();
+            body_read_ = 0;
+            watching_peer_ = false;
+#endif
+        }
+
+        void connection::arm_watchdog(std::chrono::steady_clock::duration timeout) {
+            watchdog_.expires_after(timeout);
+            watchdog_.async_wait(wrap(boost::bind(&connection::handle_watchdog,
+                                                  shared_from_this(),
+                                                  boost::asio::placeholders::error)));
+        }
+
+        void connection::handle_watchdog(const boost::system::error_code &e) {
+            if (e || !socket_.is_open() || watchdog_.expiry() > std::chrono::steady_clock::now())
+                return;
+
+            if (!writing_) {
+                if (request_begin_ != buffer_end_) {
+                    HTTP_SERVER3_LOG(debug, "Dropping a client that sent an incomplete request for too long");
+                    metrics::record_event(metrics::slow_request_dropped);
+                }
+                close();
+                return;
+            }
+
+            unsigned long long seconds = std::chrono::duration_cast<std::chrono::seconds>(throughput_interval).count();
+            if (sent_bytes_ - watchdog_sent_ < min_throughput * seconds && !shaped_) {
+                HTTP_SERVER3_LOG(debug, "Dropping a client reading " << sent_bytes_ - watchdog_sent_ << " bytes in "
+                                                                     << seconds << "s");
+                metrics::record_event(metrics::slow_response_dropped);
+                close();
+                return;
+            }
+            watchdog_sent_ = sent_bytes_;
+            shaped_ = false;
+            arm_watchdog(throughput_interval);
+        }
+
+        void connection::close() {
+            if (!socket_.is_open())
+                return;
+
+            if (writing_) {
+                metrics::record_event(metrics::transfer_aborted);
+                metrics::record_abandoned_bytes(response_bytes_ - std::min(response_bytes_, sent_bytes_));
+                end_response();
+            }
+#if defined(__linux__)
+            if (body_read_) {
+                io_uring_->cancel(body_read_);
+                body_read_ = 0;
+                metrics::record_event(metrics::disk_read_cancelled);
+            }
+#endif
+            watchdog_.cancel();
+            boost::system::error_code ignored_ec;
+            socket_.close(ignored_ec);
+        }
+
+        void connection::read_request() {
+            if (request_begin_ == buffer_end_)
+                buffer_begin_ = buffer_end_ = request_begin_ = buffer_.data();
+
+            if (buffer_end_ == buffer_.data() + buffer_.size() && !make_room()) {
+                keep_alive_ = false;
+                reply_ = reply::stock_reply(reply::bad_request);
+                write_reply();
+                return;
+            }
+
+            read_some(boost::asio::buffer(buffer_end_, buffer_.data() + buffer_.size() - buffer_end_),
+                      wrap(boost::bind(&connection::handle_read, shared_from_this(),
+                                       boost::asio::placeholders::error,
+                                       boost::asio::placeholders::bytes_transferred)));
+        }
+
+        bool connection::make_room() {
+            std::size_t pending = buffer_end_ - request_begin_;
+            std::vector<char> previous;
+            if (request_begin_ == buffer_.data()) {
+                if (buffer_.size() >= max_buffer_size)
+                    return false;
+                previous.resize(buffer_.size() * 2);
+                previous.swap(buffer_);
+                std::memcpy(buffer_.data(), request_begin_, pending);
+            } else {
+                std::memmove(buffer_.data(), request_begin_, pending);
+            }
+
+            rebase(request_, request_begin_, buffer_.data());
+            buffer_begin_ = buffer_.data() + (buffer_begin_ - request_begin_);
+            buffer_end_ = buffer_.data() + pending;
+            request_begin_ = buffer_.data();
+            return true;
         }
 
         void connection::handle_read(const boost::system::error_code &e,
                                      std::size_t bytes_transferred) {
             if (!e) {
-                boost::tribool result;
-                boost::tie(result, boost::tuples::ignore) = request_parser_.parse(
-                        request_, buffer_.data(), buffer_.data() + bytes_transferred);
-
-                if (result) {
-                    request_handler_.handle_request(request_, reply_);
-                    boost::asio::async_write(socket_, reply_.to_buffers(),
-                                             boost::asio::bind_executor(strand_,
-                                                                        boost::bind(&connection::handle_write,
-                                                                                    shared_from_this(),
-                                                                                    boost::asio::placeholders::error)));
-                } else if (!result) {
-                    reply_ = reply::stock_reply(reply::bad_request);
-                    boost::asio::async_write(socket_, reply_.to_buffers(),
-                                             boost::asio::bind_executor(strand_,
-                                                                        boost::bind(&connection::handle_write,
-                                                                                    shared_from_this(),
-                                                                                    boost::asio::placeholders::error)));
-                } else {
-                    socket_.async_read_some(boost::asio::buffer(buffer_),
-                                            boost::asio::bind_executor(strand_,
-                                                                       boost::bind(&connection::handle_read,
-                                                                                   shared_from_this(),
-                                                                                   boost::asio::placeholders::error,
-                                                                                   boost::asio::placeholders::bytes_transferred)));
+                buffer_end_ += bytes_transferred;
+                process_buffer();
+            } else if (e != boost::asio::error::operation_aborted) {
+                close();
+            }
+        }
+
+        void connection::process_buffer() {
+            if (request_body_left_ > 0) {
+                std::size_t skipped = std::min<unsigned long long>(request_body_left_, buffer_end_ - buffer_begin_);
+                buffer_begin_ += skipped;
+                request_begin_ = buffer_begin_;
+                request_body_left_ -= skipped;
+                if (request_body_left_ > 0 || buffer_begin_ == buffer_end_) {
+                    read_request();
+                    return;
+                }
+            }
+
+            if (http2_enabled_ && first_request_ && buffer_begin_ == request_begin_) {
+                std::size_t available = std::min<std::size_t>(buffer_end_ - buffer_begin_, http2_session::preface.size());
+                if (http2_session::preface.substr(0, available) == boost::string_view(buffer_begin_, available)) {
+                    if (available < http2_session::preface.size())
+                        read_request();
+                    else
+                        start_http2();
+                    return;
+                }
+            }
+
+            boost::tribool result;
+            std::chrono::steady_clock::time_point parse_start = std::chrono::steady_clock::now();
+            boost::tie(result, buffer_begin_) = request_parser_.parse(request_, buffer_begin_, buffer_end_);
+            request_start_ = std::chrono::steady_clock::now();
+            parse_time_ += request_start_ - parse_start;
+
+            if (result) {
+                metrics::record_latency(metrics::parse_time, parse_time_);
+                bool first_request = first_request_;
+                first_request_ = false;
+                keep_alive_ = wants_keep_alive(request_);
+                bool has_body = skip_request_body();
+                if (http2_enabled_ && !tls_ && !has_body && upgrade_http2(first_request))
+                    return;
+                if (admission_ && !admission_->admit(first_request)) {
+                    write_rejection();
+                    return;
                 }
+                request_handler_.handle_request(request_, reply_);
+                if (request_.method == "HEAD")
+                    drop_body(reply_);
+                write_reply();
+            } else if (!result) {
+                keep_alive_ = false;
+                reply_ = reply::stock_reply(reply::bad_request);
+                write_reply();
+            } else {
+                read_request();
             }
+        }
+
+        bool connection::skip_request_body() {
+            unsigned long long length;
+            boost::string_view content_length = header_value(request_, "Content-Length");
+            if (header_value(request_, "Transfer-Encoding").data()
+                || (content_length.data() && !parse_content_length(content_length, length))) {
+                keep_alive_ = false;
+                return true;
+            }
+            if (!content_length.data() || length == 0)
+                return false;
+
+            std::size_t skipped = std::min<unsigned long long>(length, buffer_end_ - buffer_begin_);
+            buffer_begin_ += skipped;
+            request_body_left_ = length - skipped;
+            return true;
+        }
+
+        void connection::write_reply() {
+            body_bytes_ = reply_.content.size() + boost::asio::buffer_size(reply_.body_buffers) + reply_.body_length;
+            for (const body_segment &segment : reply_.body_segments)
+                body_bytes_ += boost::asio::buffer_size(segment.buffers) + segment.length;
+            next_segment_ = 0;
+            writing_ = true;
+            sent_bytes_ = watchdog_sent_ = 0;
+            arm_watchdog(throughput_interval);
+            header date_header;
+            date_header.name = "Date";
+            date_header.value = http_date::now()->date;
+            reply_.headers.push_back(date_header);
+            header connection_header;
+            connection_header.name = "Connection";
+            connection_header.value = keep_alive_ ? "keep-alive" : "close";
+            reply_.headers.push_back(connection_header);
+            memory_ = reply_.to_buffers();
+            next_memory_ = 0;
+            memory_head_ = boost::asio::buffer_size(memory_) - reply_.content.size()
+                           - boost::asio::buffer_size(reply_.body_buffers);
+            response_bytes_ = memory_head_ + body_bytes_;
+            if (admission_)
+                admission_->reserve(response_bytes_);
+            write_memory();
+        }
 
+        void connection::write_rejection() {
+            keep_alive_ = false;
+            reply_.status = reply::service_unavailable;
+            date_ = http_date::now();
+            boost::array<boost::asio::const_buffer, 4> buffers = {{
+                    boost::asio::buffer(admission_->rejection_head()),
+                    boost::asio::buffer(date_->date),
+                    boost::asio::buffer(header_end),
+                    boost::asio::buffer(admission_->rejection_body())
+            }};
+            body_bytes_ = admission_->rejection_body().size();
+            response_bytes_ = boost::asio::buffer_size(buffers) - body_bytes_;
+            next_segment_ = 0;
+            writing_ = true;
+            sent_bytes_ = watchdog_sent_ = 0;
+            arm_watchdog(throughput_interval);
+            admission_->reserve(response_bytes_);
+            write(buffers, wrap(boost::bind(&connection::handle_write,
+                                            shared_from_this(),
+                                            boost::asio::placeholders::error,
+                                            boost::asio::placeholders::bytes_transferred)));
         }
 
-        void connection::handle_write(const boost::system::error_code &e) {
+        void connection::end_response() {
+            if (!writing_)
+                return;
+            writing_ = false;
+            if (admission_)
+                admission_->release(response_bytes_);
+        }
+
+        void connection::handle_write(const boost::system::error_code &e, std::size_t bytes_transferred) {
+            sent_bytes_ += bytes_transferred;
             if (!e) {
-                boost::system::error_code ignored_ec;
-                socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
+                metrics::record_latency(metrics::time_to_first_byte, std::chrono::steady_clock::now() - request_start_);
+                start_body();
+            } else {
+                close();
+            }
+        }
+
+        bool connection::upgrade_http2(bool first_request) {
+            boost::string_view settings = header_value(request_, "HTTP2-Settings");
+            boost::string_view upgrade = header_value(request_, "Upgrade");
+            if ((request_.method != "GET" && request_.method != "HEAD") || !settings.data()
+                || !boost::algorithm::ifind_first(upgrade, "h2c"))
+                return false;
+
+            http2_.reset(new http2_session(request_handler_, admission_, first_request));
+            if (!http2_->upgrade(request_, settings)) {
+                http2_.reset();
+                return false;
+            }
+            metrics::record_event(metrics::http2_connection);
+            write(boost::asio::buffer(switching_protocols, sizeof(switching_protocols) - 1),
+                  wrap(boost::bind(&connection::handle_upgrade, shared_from_this(), boost::asio::placeholders::error)));
+            return true;
+        }
+
+        void connection::handle_upgrade(const boost::system::error_code &e) {
+            if (e) {
+                close();
+                return;
+            }
+            start_http2();
+        }
+
+        void connection::start_http2() {
+            if (!http2_) {
+                http2_.reset(new http2_session(request_handler_, admission_, first_request_));
+                metrics::record_event(metrics::http2_connection);
+            }
+            first_request_ = false;
+            boost::system::error_code ignored_ec;
+            socket_.set_option(boost::asio::ip::tcp::no_delay(true), ignored_ec);
+            request_ = request();
+            request_parser_.reset();
+            if (buffer_begin_ != buffer_end_)
+                http2_->consume(buffer_begin_, buffer_end_ - buffer_begin_);
+            buffer_begin_ = buffer_end_ = request_begin_ = buffer_.data();
+            watch_http2();
+            write_http2();
+            read_http2();
+        }
+
+        void connection::read_http2() {
+            http2_reading_ = true;
+            read_some(boost::asio::buffer(buffer_),
+                      wrap(boost::bind(&connection::handle_http2_read, shared_from_this(),
+                                       boost::asio::placeholders::error,
+                                       boost::asio::placeholders::bytes_transferred)));
+        }
+
+        void connection::handle_http2_read(const boost::system::error_code &e, std::size_t bytes_transferred) {
+            http2_reading_ = false;
+            if (e) {
+                if (e != boost::asio::error::operation_aborted)
+                    close();
+                return;
             }
+
+            http2_->consume(buffer_.data(), bytes_transferred);
+            watch_http2();
+            write_http2();
+            if (!http2_->congested())
+                read_http2();
+        }
+
+        void connection::write_http2() {
+            if (http2_writing_ || !socket_.is_open())
+                return;
+            std::size_t budget = 0;
+            if (!http2_throttled_ && http2_->data_pending()) {
+                budget = send_window;
+                if (!shape(budget)) {
+                    http2_throttled_ = true;
+                    budget = 0;
+                }
+            }
+            if (!http2_->next_output(http2_output_, budget)) {
+                if (http2_->finished())
+                    hang_up();
+                return;
+            }
+
+            http2_writing_ = true;
+            write(http2_output_.buffers, wrap(boost::bind(&connection::handle_http2_write,
+                                                          shared_from_this(),
+                                                          boost::asio::placeholders::error,
+                                                          boost::asio::placeholders::bytes_transferred)));
+        }
+
+        void connection::handle_http2_write(const boost::system::error_code &e, std::size_t bytes_transferred) {
+            sent_bytes_ += bytes_transferred;
+            charge(bytes_transferred);
+            if (e) {
+                close();
+                return;
+            }
+            if (http2_output_.length == 0) {
+                http2_written();
+                return;
+            }
+
+            reply_.body_file = http2_output_.file;
+            reply_.body_offset = http2_output_.offset;
+            reply_.body_length = http2_output_.length;
+#if defined(__linux__)
+            if (kernel_body()) {
+                send_body();
+                return;
+            }
+#endif
+            copy_body();
+        }
+
+        void connection::http2_written() {
+            http2_writing_ = false;
+            reply_.body_file.reset();
+            http2_->written();
+            watch_http2();
+            write_http2();
+            if (!http2_reading_ && !http2_->congested() && socket_.is_open())
+                read_http2();
+        }
+
+        void connection::watch_http2() {
+            if (http2_->active() == writing_)
+                return;
+            writing_ = http2_->active();
+            watchdog_sent_ = sent_bytes_;
+            arm_watchdog(writing_ ? throughput_interval : request_timeout);
+        }
+
+        void connection::start_body() {
+            if (reply_.body_file && reply_.body_length > 0) {
+#if defined(__linux__)
+                if (kernel_body()) {
+                    if (io_uring_)
+                        read_body_chunk();
+                    else
+                        send_body();
+                    return;
+                }
+#endif
+                copy_body();
+                return;
+            }
+            write_segment();
+        }
+
+        void connection::write_segment() {
+            if (next_segment_ == reply_.body_segments.size()) {
+                finish();
+                return;
+            }
+
+            const body_segment &segment = reply_.body_segments[next_segment_++];
+            reply_.body_offset = segment.offset;
+            reply_.body_length = segment.length;
+            memory_ = segment.buffers;
+            next_memory_ = 0;
+            write_memory();
+        }
+
+        void connection::write_memory() {
+            std::size_t count = send_window, remaining = 0;
+            for (std::size_t i = next_memory_; i < memory_.size(); ++i)
+                remaining += memory_[i].size();
+            if (remaining > memory_head_ && !shape(count))
+                return;
+
+            count += memory_head_;
+            std::vector<boost::asio::const_buffer> buffers;
+            while (count > 0 && next_memory_ < memory_.size()) {
+                boost::asio::const_buffer &buffer = memory_[next_memory_];
+                std::size_t n = std::min(count, buffer.size());
+                buffers.push_back(boost::asio::buffer(buffer.data(), n));
+                buffer += n;
+                count -= n;
+                if (buffer.size() == 0)
+                    ++next_memory_;
+            }
+            write(buffers, wrap(boost::bind(&connection::handle_memory_write,
+                                            shared_from_this(),
+                                            boost::asio::placeholders::error,
+                                            boost::asio::placeholders::bytes_transferred)));
+        }
+
+        void connection::handle_memory_write(const boost::system::error_code &e, std::size_t bytes_transferred) {
+            sent_bytes_ += bytes_transferred;
+            charge(bytes_transferred - std::min(bytes_transferred, memory_head_));
+            if (e) {
+                close();
+                return;
+            }
+            if (memory_head_ > 0) {
+                metrics::record_latency(metrics::time_to_first_byte, std::chrono::steady_clock::now() - request_start_);
+                memory_head_ = 0;
+            }
+            if (next_memory_ < memory_.size()) {
+                write_memory();
+                return;
+            }
+            memory_.clear();
+            next_memory_ = 0;
+            start_body();
+        }
+
+        bool connection::shape(std::size_t &count) {
+            if (!shaper_)
+                return true;
+
+            std::size_t granted = shaper_->acquire(shaping_, count);
+            if (granted == 0) {
+                shaped_ = true;
+                shaper_->wait(shaping_, count, shared_from_this());
+                return false;
+            }
+            count = std::min(count, granted);
+            return true;
+        }
+
+        void connection::charge(std::size_t bytes) {
+            if (shaper_)
+                shaper_->consume(shaping_, bytes);
+        }
+
+        void connection::resume() {
+            boost::asio::post(executor_, wrap(boost::bind(&connection::handle_shaped, shared_from_this())));
+        }
+
+        void connection::handle_shaped() {
+            if (!socket_.is_open())
+                return;
+            if (http2_throttled_) {
+                http2_throttled_ = false;
+                write_http2();
+                return;
+            }
+            if (next_memory_ < memory_.size()) {
+                write_memory();
+                return;
+            }
+#if defined(__linux__)
+            if (kernel_body()) {
+                if (io_uring_ && !http2_)
+                    send_body_chunk();
+                else
+                    send_body();
+                return;
+            }
+#endif
+            copy_body();
+        }
+
+        void connection::body_written() {
+            if (http2_)
+                http2_written();
+            else
+                write_segment();
+        }
+
+        bool connection::kernel_body() const {
+            return !tls_ || tls_->kernel_send();
+        }
+
+        void connection::copy_body() {
+            std::size_t count = std::min<unsigned long long>(reply_.body_length, send_window);
+            if (!shape(count))
+                return;
+            body_buffer_.resize(count);
+            ssize_t n = ::pread(reply_.body_file->file->native_handle(), body_buffer_.data(), count, reply_.body_offset);
+            if (n <= 0) {
+                close();
+                return;
+            }
+            reply_.body_offset += n;
+            reply_.body_length -= n;
+            write(boost::asio::buffer(body_buffer_.data(), n),
+                  wrap(boost::bind(&connection::handle_body_copied,
+                                   shared_from_this(),
+                                   boost::asio::placeholders::error,
+                                   boost::asio::placeholders::bytes_transferred)));
+        }
+
+        void connection::handle_body_copied(const boost::system::error_code &e, std::size_t bytes_transferred) {
+            sent_bytes_ += bytes_transferred;
+            charge(bytes_transferred);
+            if (!e) {
+                if (reply_.body_length > 0) {
+                    copy_body();
+                    return;
+                }
+                body_written();
+            } else {
+                close();
+            }
+        }
+
+#if defined(__linux__)
+
+        void connection::send_body() {
+            if (!socket_.native_non_blocking())
+                socket_.native_non_blocking(true);
+
+            off_t offset = reply_.body_offset;
+            std::size_t count = std::min<unsigned long long>(reply_.body_length, send_window);
+            if (!shape(count))
+                return;
+            ssize_t n = ::sendfile(socket_.native_handle(), reply_.body_file->file->native_handle(), &offset, count);
+            if (n > 0) {
+                sent_bytes_ += n;
+                charge(n);
+                reply_.body_offset += n;
+                reply_.body_length -= n;
+                if (reply_.body_length == 0) {
+                    body_written();
+                    return;
+                }
+            } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                close();
+                return;
+            }
+            if (n < static_cast<ssize_t>(count))
+                metrics::record_event(metrics::send_window_full);
+
+            socket_.async_wait(boost::asio::ip::tcp::socket::wait_write,
+                               wrap(boost::bind(&connection::handle_body_write,
+                                                shared_from_this(),
+                                                boost::asio::placeholders::error)));
+        }
+
+        void connection::handle_body_write(const boost::system::error_code &e) {
+            if (!e) {
+                send_body();
+            } else {
+                close();
+            }
+        }
+
+        void connection::watch_peer() {
+            watching_peer_ = true;
+            socket_.async_wait(boost::asio::ip::tcp::socket::wait_error,
+                               wrap(boost::bind(&connection::handle_peer_error,
+                                                shared_from_this(),
+                                                boost::asio::placeholders::error)));
+        }
+
+        void connection::handle_peer_error(const boost::system::error_code &e) {
+            watching_peer_ = false;
+            if (e || !socket_.is_open())
+                return;
+
+            pollfd state = {socket_.native_handle(), 0, 0};
+            if (::poll(&state, 1, 0) > 0 && (state.revents & (POLLERR | POLLHUP))) {
+                HTTP_SERVER3_LOG(debug, "Client went away during the response");
+                close();
+                return;
+            }
+            watch_peer();
+        }
+
+        void connection::read_body_chunk() {
+            if (!watching_peer_)
+                watch_peer();
+            if (body_chunk_ && reply_.body_offset >= body_chunk_start_
+                && reply_.body_offset < body_chunk_start_ + body_chunk_->size()) {
+                send_body_chunk();
+                return;
+            }
+
+            const cached_file &file = *reply_.body_file;
+            unsigned long long index = reply_.body_offset / chunk_cache::chunk_size;
+            body_chunk_start_ = index * chunk_cache::chunk_size;
+            std::size_t size = std::min<unsigned long long>(chunk_cache::chunk_size, file.size - body_chunk_start_);
+            body_chunk_.reset(new std::string(size, '\0'));
+            body_read_ = io_uring_->async_read(file.file->native_handle(), &(*body_chunk_)[0], size, body_chunk_start_,
+                                  wrap(boost::bind(&connection::handle_body_read,
+                                                   shared_from_this(),
+                                                   boost::asio::placeholders::error,
+                                                   boost::asio::placeholders::bytes_transferred)));
+        }
+
+        void connection::handle_body_read(const boost::system::error_code &e, std::size_t bytes_transferred) {
+            body_read_ = 0;
+            if (e || bytes_transferred != body_chunk_->size()) {
+                close();
+                return;
+            }
+
+            request_handler_.offer_chunk(*reply_.body_file, body_chunk_start_ / chunk_cache::chunk_size, body_chunk_);
+            send_body_chunk();
+        }
+
+        void connection::send_body_chunk() {
+            std::size_t from = reply_.body_offset - body_chunk_start_;
+            std::size_t size = std::min<unsigned long long>(reply_.body_length, body_chunk_->size() - from);
+            if (!shape(size))
+                return;
+            io_uring_->async_send(socket_.native_handle(), body_chunk_->data() + from, size,
+                                  wrap(boost::bind(&connection::handle_body_sent,
+                                                   shared_from_this(),
+                                                   boost::asio::placeholders::error,
+                                                   boost::asio::placeholders::bytes_transferred)));
+        }
+
+        void connection::handle_body_sent(const boost::system::error_code &e, std::size_t bytes_transferred) {
+            if (e || bytes_transferred == 0) {
+                close();
+                return;
+            }
+
+            sent_bytes_ += bytes_transferred;
+            charge(bytes_transferred);
+            reply_.body_offset += bytes_transferred;
+            reply_.body_length -= bytes_transferred;
+            if (reply_.body_length == 0) {
+                write_segment();
+            } else if (reply_.body_offset < body_chunk_start_ + body_chunk_->size()) {
+                send_body_chunk();
+            } else {
+                read_body_chunk();
+            }
+        }
+
+#endif
+
+        void connection::finish() {
+            std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - request_start_;
+            metrics::record_request(reply_.status, body_bytes_);
+            metrics::record_latency(metrics::response_time, elapsed);
+            if (logging::access_enabled.load(std::memory_order_relaxed))
+                logging::access(request_.uri, header_value(request_, "Range"), reply_.status, body_bytes_, elapsed);
+            parse_time_ = std::chrono::steady_clock::duration::zero();
+            end_response();
+#if defined(__linux__)
+            body_chunk_.reset();
+#endif
+
+            if (!keep_alive_) {
+                hang_up();
+                return;
+            }
+
+            request_ = request();
+            request_parser_.reset();
+            reply_ = reply();
+            request_begin_ = buffer_begin_;
+            arm_watchdog(request_timeout);
+
+            if (buffer_begin_ != buffer_end_)
+                process_buffer();
+            else
+                read_request();
+        }
+
+        void connection::hang_up() {
+            watchdog_.cancel();
+            reply_.body_file.reset();
+            if (tls_)
+                tls_->shutdown();
+            boost::system::error_code ignored_ec;
+            socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
         }
     }
 }
@@ -2,48 +2,258 @@
 #define HTTP_SERVER3_CONNECTION_HPP
 
 #include <boost/asio.hpp>
-#include <boost/array.hpp>
+#include <chrono>
+#include <vector>
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include "reply.hpp"
 #include "request.hpp"
 #include "request_handler.hpp"
 #include "request_parser.hpp"
+#include "io_uring_service.hpp"
+#include "handler_allocator.hpp"
+#include "bandwidth_shaper.hpp"
+#include "admission_control.hpp"
+#include "http_date.hpp"
+#include "tls_stream.hpp"
+#include "http2_session.hpp"
 
 namespace http {
     namespace server3 {
 
+        class io_uring_service;
+
         class connection
                 : public boost::enable_shared_from_this<connection>,
+                  public bandwidth_shaper::waiter,
                   private boost::noncopyable {
         public:
             explicit connection(boost::asio::io_context &io_context,
-                                request_handler &handler);
+                                request_handler &handler,
+                                io_uring_service *io_uring = 0,
+                                bool single_threaded = false,
+                                bandwidth_shaper *shaper = 0,
+                                admission_control *admission = 0,
+                                tls_context *tls = 0,
+                                bool http2 = false);
+
+            ~connection();
 
             boost::asio::ip::tcp::socket &socket();
 
             void start();
 
+            void reset();
+
+            virtual void resume();
+
         private:
+            template<typename Handler>
+            boost::asio::executor_binder<custom_alloc_handler<Handler>, boost::asio::any_io_executor>
+            wrap(Handler handler) {
+                return boost::asio::bind_executor(executor_, make_custom_alloc_handler(handler_memory_, handler));
+            }
+
+            template<typename MutableBufferSequence, typename Handler>
+            void read_some(const MutableBufferSequence &buffers, Handler handler) {
+                if (tls_)
+                    tls_->async_read_some(buffers, handler);
+                else
+                    socket_.async_read_some(buffers, handler);
+            }
+
+            template<typename ConstBufferSequence, typename Handler>
+            void write(const ConstBufferSequence &buffers, Handler handler) {
+                if (tls_ && !tls_->kernel_send())
+                    boost::asio::async_write(*tls_, buffers, handler);
+                else
+                    boost::asio::async_write(socket_, buffers, handler);
+            }
+
+            void handle_handshake(const boost::system::error_code &e);
+
+            void arm_watchdog(std::chrono::steady_clock::duration timeout);
+
+            void handle_watchdog(const boost::system::error_code &e);
+
+            void close();
+
+            void read_request();
+
+            bool make_room();
+
             void handle_read(const boost::system::error_code &e,
                              std::size_t bytes_transferred);
 
-            void handle_write(const boost::system::error_code &e);
+            void process_buffer();
+
+            bool skip_request_body();
+
+            void write_reply();
+
+            void write_rejection();
+
+            void end_response();
+
+            void handle_write(const boost::system::error_code &e, std::size_t bytes_transferred);
+
+            bool upgrade_http2(bool first_request);
+
+            void handle_upgrade(const boost::system::error_code &e);
+
+            void start_http2();
+
+            void read_http2();
+
+            void handle_http2_read(const boost::system::error_code &e, std::size_t bytes_transferred);
 
-            boost::asio::io_context::strand strand_;
+            void write_http2();
+
+            void handle_http2_write(const boost::system::error_code &e, std::size_t bytes_transferred);
+
+            void http2_written();
+
+            void watch_http2();
+
+            void start_body();
+
+            void write_segment();
+
+            void write_memory();
+
+            void handle_memory_write(const boost::system::error_code &e, std::size_t bytes_transferred);
+
+            bool shape(std::size_t &count);
+
+            void charge(std::size_t bytes);
+
+            void handle_shaped();
+
+            bool kernel_body() const;
+
+            void copy_body();
+
+            void handle_body_copied(const boost::system::error_code &e, std::size_t bytes_transferred);
+
+            void body_written();
+
+#if defined(__linux__)
+            void send_body();
+
+            void handle_body_write(const boost::system::error_code &e);
+
+            void watch_peer();
+
+            void handle_peer_error(const boost::system::error_code &e);
+
+            void read_body_chunk();
+
+            void handle_body_read(const boost::system::error_code &e, std::size_t bytes_transferred);
+
+            void send_body_chunk();
+
+            void handle_body_sent(const boost::system::error_code &e, std::size_t bytes_transferred);
+#endif
+
+            void finish();
+
+            void hang_up();
+
+            handler_memory handler_memory_;
+
+            boost::asio::any_io_executor executor_;
 
             boost::asio::ip::tcp::socket socket_;
 
+            boost::asio::steady_timer watchdog_;
+
             request_handler &request_handler_;
 
-            boost::array<char, 8192> buffer_;
+            io_uring_service *io_uring_;
+
+            bandwidth_shaper *shaper_;
+
+            bandwidth_shaper::stream shaping_;
+
+            bool shaped_;
+
+            admission_control *admission_;
+
+            bool first_request_;
+
+            boost::shared_ptr<const http_date::snapshot> date_;
+
+            tls_context *tls_context_;
+
+            boost::scoped_ptr<tls_stream> tls_;
+
+            bool http2_enabled_;
+
+            boost::scoped_ptr<http2_session> http2_;
+
+            http2_session::output http2_output_;
+
+            bool http2_reading_;
+
+            bool http2_writing_;
+
+            bool http2_throttled_;
+
+            std::vector<char> body_buffer_;
+
+            std::vector<char> buffer_;
+
+            char *request_begin_;
+
+            char *buffer_begin_;
+
+            char *buffer_end_;
+
+            bool keep_alive_;
+
+            unsigned long long request_body_left_;
 
             request request_;
 
             request_parser request_parser_;
 
             reply reply_;
+
+            std::chrono::steady_clock::time_point request_start_;
+
+            unsigned long long body_bytes_;
+
+            unsigned long long response_bytes_;
+
+            unsigned long long sent_bytes_;
+
+            unsigned long long watchdog_sent_;
+
+            bool writing_;
+
+            std::size_t next_segment_;
+
+            std::vector<boost::asio::const_buffer> memory_;
+
+            std::size_t next_memory_;
+
+            std::size_t memory_head_;
+
+            std::chrono::steady_clock::duration parse_time_;
+
+            bool started_;
+
+#if defined(__linux__)
+            boost::shared_ptr<std::string> body_chunk_;
+
+            unsigned long long body_chunk_start_;
+
+            io_uring_service::ticket body_read_;
+
+            bool watching_peer_;
+#endif
         };
 
         typedef boost::shared_ptr<connection> connection_ptr;
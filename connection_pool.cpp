@@ -0,0 +1,72 @@
+#include "connection_pool.hpp"
+#include <boost/thread/locks.hpp>
+#include "handler_allocator.hpp"
+
+namespace http {
+    namespace server3 {
+
+        connection_pool::connection_pool(boost::asio::io_context &io_context, request_handler &handler,
+                                         io_uring_service *io_uring, bool single_threaded, bandwidth_shaper *shaper,
+                                         admission_control *admission, tls_context *tls, bool http2,
+                                         std::size_t max_idle)
+                : io_context_(io_context),
+                  request_handler_(handler),
+                  io_uring_(io_uring),
+                  shaper_(shaper),
+                  admission_(admission),
+                  tls_(tls),
+                  http2_(http2),
+                  state_(new state()) {
+            state_->max_idle = max_idle;
+            state_->single_threaded = single_threaded;
+            state_->open = true;
+            state_->idle.reserve(max_idle);
+        }
+
+        connection_pool::~connection_pool() {
+            std::vector<connection *> idle;
+            {
+                boost::lock_guard<boost::mutex> lock(state_->mutex);
+                state_->open = false;
+                idle.swap(state_->idle);
+            }
+            for (std::size_t i = 0; i < idle.size(); ++i)
+                delete idle[i];
+        }
+
+        connection_ptr connection_pool::acquire() {
+            connection *c = 0;
+            {
+                boost::unique_lock<boost::mutex> lock(state_->mutex, boost::defer_lock);
+                if (!state_->single_threaded)
+                    lock.lock();
+                if (!state_->idle.empty()) {
+                    c = state_->idle.back();
+                    state_->idle.pop_back();
+                }
+            }
+            if (!c)
+                c = new connection(io_context_, request_handler_, io_uring_, state_->single_threaded, shaper_,
+                                   admission_, tls_, http2_);
+
+            recycler r;
+            r.pool = state_;
+            return connection_ptr(c, r, recycling_allocator<connection>());
+        }
+
+        void connection_pool::recycler::operator()(connection *c) const {
+            c->reset();
+            {
+                boost::unique_lock<boost::mutex> lock(pool->mutex, boost::defer_lock);
+                if (!pool->single_threaded)
+                    lock.lock();
+                if (pool->open && pool->idle.size() < pool->max_idle) {
+                    pool->idle.push_back(c);
+                    return;
+                }
+            }
+            delete c;
+        }
+
+    }
+}
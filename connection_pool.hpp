@@ -0,0 +1,59 @@
+#ifndef HTTP_SERVER3_CONNECTION_POOL_HPP
+#define HTTP_SERVER3_CONNECTION_POOL_HPP
+
+#include <vector>
+#include <boost/asio/io_context.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "connection.hpp"
+
+namespace http {
+    namespace server3 {
+
+        class connection_pool : private boost::noncopyable {
+        public:
+            connection_pool(boost::asio::io_context &io_context, request_handler &handler, io_uring_service *io_uring,
+                            bool single_threaded, bandwidth_shaper *shaper = 0, admission_control *admission = 0,
+                            tls_context *tls = 0, bool http2 = false, std::size_t max_idle = 1024);
+
+            ~connection_pool();
+
+            connection_ptr acquire();
+
+        private:
+            struct state : private boost::noncopyable {
+                boost::mutex mutex;
+                std::vector<connection *> idle;
+                std::size_t max_idle;
+                bool single_threaded;
+                bool open;
+            };
+
+            struct recycler {
+                void operator()(connection *c) const;
+
+                boost::shared_ptr<state> pool;
+            };
+
+            boost::asio::io_context &io_context_;
+
+            request_handler &request_handler_;
+
+            io_uring_service *io_uring_;
+
+            bandwidth_shaper *shaper_;
+
+            admission_control *admission_;
+
+            tls_context *tls_;
+
+            bool http2_;
+
+            boost::shared_ptr<state> state_;
+        };
+
+    }
+}
+
+#endif
@@ -0,0 +1,308 @@
+#include "etag_index.hpp"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/asio/post.hpp>
+#include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/locks.hpp>
+#include "logging.hpp"
+
+namespace http {
+    namespace server3 {
+
+        namespace {
+            const char index_magic[8] = {'H', 'S', '3', 'E', 'T', 'A', 'G', '1'};
+
+            const std::size_t block_size = 256 * 1024;
+
+            struct record {
+                boost::uint64_t device;
+                boost::uint64_t inode;
+                boost::int64_t modification_ms;
+                boost::uint64_t size;
+                boost::uint64_t hash;
+            };
+
+            const boost::uint64_t prime1 = 11400714785074694791ULL;
+            const boost::uint64_t prime2 = 14029467366897019727ULL;
+            const boost::uint64_t prime3 = 1609587929392839161ULL;
+            const boost::uint64_t prime4 = 9650029242287828579ULL;
+            const boost::uint64_t prime5 = 2870177450012600261ULL;
+
+            inline boost::uint64_t rotl(boost::uint64_t x, int r) {
+                return (x << r) | (x >> (64 - r));
+            }
+
+            inline boost::uint64_t read64(const unsigned char *p) {
+                boost::uint64_t v;
+                std::memcpy(&v, p, sizeof(v));
+                return v;
+            }
+
+            inline boost::uint32_t read32(const unsigned char *p) {
+                boost::uint32_t v;
+                std::memcpy(&v, p, sizeof(v));
+                return v;
+            }
+
+            inline boost::uint64_t xxh_round(boost::uint64_t acc, boost::uint64_t input) {
+                return rotl(acc + input * prime2, 31) * prime1;
+            }
+
+            inline boost::uint64_t xxh_merge(boost::uint64_t acc, boost::uint64_t value) {
+                return (acc ^ xxh_round(0, value)) * prime1 + prime4;
+            }
+
+            class xxh64 {
+            public:
+                xxh64() : total_(0), buffered_(0) {
+                    v_[0] = prime1 + prime2;
+                    v_[1] = prime2;
+                    v_[2] = 0;
+                    v_[3] = -prime1;
+                }
+
+                void update(const unsigned char *data, std::size_t size) {
+                    total_ += size;
+                    if (buffered_ > 0) {
+                        std::size_t take = std::min(size, sizeof(buffer_) - buffered_);
+                        std::memcpy(buffer_ + buffered_, data, take);
+                        buffered_ += take;
+                        data += take;
+                        size -= take;
+                        if (buffered_ < sizeof(buffer_))
+                            return;
+                        stripe(buffer_);
+                        buffered_ = 0;
+                    }
+                    for (; size >= sizeof(buffer_); data += sizeof(buffer_), size -= sizeof(buffer_))
+                        stripe(data);
+                    std::memcpy(buffer_, data, size);
+                    buffered_ = size;
+                }
+
+                boost::uint64_t digest() const {
+                    boost::uint64_t h;
+                    if (total_ >= sizeof(buffer_)) {
+                        h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+                        for (int i = 0; i < 4; ++i)
+                            h = xxh_merge(h, v_[i]);
+                    } else {
+                        h = prime5;
+                    }
+                    h += total_;
+
+                    const unsigned char *p = buffer_, *end = buffer_ + buffered_;
+                    for (; p + 8 <= end; p += 8)
+                        h = rotl(h ^ xxh_round(0, read64(p)), 27) * prime1 + prime4;
+                    if (p + 4 <= end) {
+                        h = rotl(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+                        p += 4;
+                    }
+                    for (; p < end; ++p)
+                        h = rotl(h ^ (*p * prime5), 11) * prime1;
+
+                    h ^= h >> 33;
+                    h *= prime2;
+                    h ^= h >> 29;
+                    h *= prime3;
+                    h ^= h >> 32;
+                    return h;
+                }
+
+            private:
+                void stripe(const unsigned char *p) {
+                    for (int i = 0; i < 4; ++i)
+                        v_[i] = xxh_round(v_[i], read64(p + 8 * i));
+                }
+
+                boost::uint64_t v_[4];
+                boost::uint64_t total_;
+                unsigned char buffer_[32];
+                std::size_t buffered_;
+            };
+
+            long long int modification_ms(const struct stat &info) {
+#if defined(__APPLE__)
+                return info.st_mtimespec.tv_sec * 1000LL + info.st_mtimespec.tv_nsec / 1000000;
+#else
+                return info.st_mtim.tv_sec * 1000LL + info.st_mtim.tv_nsec / 1000000;
+#endif
+            }
+
+            void append_hex(std::string &out, unsigned long long value) {
+                char digits[17];
+                int size = std::snprintf(digits, sizeof(digits), "%llx", value);
+                out.append(digits, size);
+            }
+
+            std::string quote(boost::uint64_t hash, boost::string_view suffix) {
+                char digits[17];
+                std::snprintf(digits, sizeof(digits), "%016llx", static_cast<unsigned long long>(hash));
+                std::string tag = "\"";
+                tag.append(digits, 16);
+                tag.append(suffix.data(), suffix.size());
+                tag += '"';
+                return tag;
+            }
+        }
+
+        std::size_t etag_index::key_hash::operator()(const key &k) const {
+            std::size_t seed = 0;
+            boost::hash_combine(seed, k.device);
+            boost::hash_combine(seed, k.inode);
+            boost::hash_combine(seed, k.modification_ms);
+            boost::hash_combine(seed, k.size);
+            return seed;
+        }
+
+        etag_index::etag_index(std::size_t max_entries)
+                : max_entries_(max_entries),
+                  index_file_(0),
+                  pool_(1) {
+        }
+
+        etag_index::~etag_index() {
+            pool_.stop();
+            pool_.join();
+            if (index_file_)
+                std::fclose(index_file_);
+        }
+
+        void etag_index::open(const std::string &path) {
+            std::vector<record> records;
+            if (std::FILE *existing = std::fopen(path.c_str(), "rb")) {
+                char magic[sizeof(index_magic)];
+                if (std::fread(magic, 1, sizeof(magic), existing) == sizeof(magic)
+                    && std::memcmp(magic, index_magic, sizeof(magic)) == 0) {
+                    record r;
+                    while (std::fread(&r, sizeof(r), 1, existing) == 1)
+                        records.push_back(r);
+                }
+                std::fclose(existing);
+            }
+
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            std::size_t first = records.size() > max_entries_ ? records.size() - max_entries_ : 0;
+            for (std::size_t i = first; i < records.size(); ++i) {
+                key k = {static_cast<dev_t>(records[i].device), static_cast<ino_t>(records[i].inode),
+                         records[i].modification_ms, records[i].size};
+                entry e = {records[i].hash, false};
+                entries_[k] = e;
+            }
+
+            std::string temporary = path + ".tmp";
+            std::FILE *compacted = std::fopen(temporary.c_str(), "wb");
+            bool written = compacted && std::fwrite(index_magic, sizeof(index_magic), 1, compacted) == 1;
+            for (boost::unordered_map<key, entry, key_hash>::const_iterator it = entries_.begin();
+                 written && it != entries_.end(); ++it) {
+                record r = {static_cast<boost::uint64_t>(it->first.device), static_cast<boost::uint64_t>(it->first.inode),
+                            it->first.modification_ms, it->first.size, it->second.hash};
+                written = std::fwrite(&r, sizeof(r), 1, compacted) == 1;
+            }
+            if (compacted && std::fclose(compacted) != 0)
+                written = false;
+            if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+                std::remove(temporary.c_str());
+                HTTP_SERVER3_LOG(warning, "Cannot write ETag index " << path << ", hashes will not be persisted");
+                return;
+            }
+
+            index_file_ = std::fopen(path.c_str(), "ab");
+            HTTP_SERVER3_LOG(info, "Loaded " << entries_.size() << " content hashes from " << path);
+        }
+
+        std::string etag_index::find(const cached_file_ptr &file, boost::string_view suffix) {
+            key k = {file->device, file->inode, file->modification_ms, file->size};
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                boost::unordered_map<key, entry, key_hash>::const_iterator it = entries_.find(k);
+                if (it != entries_.end()) {
+                    if (!it->second.pending)
+                        return quote(it->second.hash, suffix);
+                } else {
+                    make_room();
+                    entry pending = {0, true};
+                    entries_.emplace(k, pending);
+                    boost::asio::post(pool_, boost::bind(&etag_index::compute, this, file, k));
+                }
+            }
+            return validator(*file, suffix);
+        }
+
+        std::string etag_index::validator(const cached_file &file, boost::string_view suffix) {
+            std::string tag = "\"";
+            append_hex(tag, static_cast<unsigned long long>(file.inode));
+            tag += '-';
+            append_hex(tag, static_cast<unsigned long long>(file.modification_ms));
+            tag += '-';
+            append_hex(tag, file.size);
+            tag.append(suffix.data(), suffix.size());
+            tag += '"';
+            return tag;
+        }
+
+        void etag_index::compute(const cached_file_ptr &file, const key &k) {
+            int fd = file->file->native_handle();
+            xxh64 state;
+            std::vector<unsigned char> block(block_size);
+            unsigned long long offset = 0;
+            while (offset < k.size) {
+                ssize_t n = ::pread(fd, block.data(), std::min<unsigned long long>(block.size(), k.size - offset),
+                                    offset);
+                if (n <= 0) {
+                    discard(k);
+                    return;
+                }
+                state.update(block.data(), n);
+                offset += n;
+            }
+
+            struct stat info;
+            if (::fstat(fd, &info) != 0 || static_cast<unsigned long long>(info.st_size) != k.size
+                || modification_ms(info) != k.modification_ms) {
+                discard(k);
+                return;
+            }
+            store(k, state.digest());
+        }
+
+        void etag_index::store(const key &k, boost::uint64_t hash) {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            boost::unordered_map<key, entry, key_hash>::iterator it = entries_.find(k);
+            if (it == entries_.end())
+                return;
+
+            it->second.hash = hash;
+            it->second.pending = false;
+            if (index_file_) {
+                record r = {static_cast<boost::uint64_t>(k.device), static_cast<boost::uint64_t>(k.inode),
+                            k.modification_ms, k.size, hash};
+                if (std::fwrite(&r, sizeof(r), 1, index_file_) != 1 || std::fflush(index_file_) != 0) {
+                    HTTP_SERVER3_LOG(warning, "Cannot append to the ETag index, hashes will not be persisted");
+                    std::fclose(index_file_);
+                    index_file_ = 0;
+                }
+            }
+        }
+
+        void etag_index::discard(const key &k) {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            entries_.erase(k);
+        }
+
+        void etag_index::make_room() {
+            boost::unordered_map<key, entry, key_hash>::iterator it = entries_.begin();
+            while (entries_.size() >= max_entries_ && it != entries_.end()) {
+                if (it->second.pending)
+                    ++it;
+                else
+                    it = entries_.erase(it);
+            }
+        }
+
+    }
+}
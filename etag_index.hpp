@@ -0,0 +1,73 @@
+#ifndef HTTP_SERVER3_ETAG_INDEX_HPP
+#define HTTP_SERVER3_ETAG_INDEX_HPP
+
+#include <cstdio>
+#include <string>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility/string_view.hpp>
+#include "file_cache.hpp"
+
+namespace http {
+    namespace server3 {
+
+        class etag_index : private boost::noncopyable {
+        public:
+            explicit etag_index(std::size_t max_entries = 65536);
+
+            ~etag_index();
+
+            void open(const std::string &path);
+
+            std::string find(const cached_file_ptr &file, boost::string_view suffix = boost::string_view());
+
+            static std::string validator(const cached_file &file, boost::string_view suffix = boost::string_view());
+
+        private:
+            struct key {
+                dev_t device;
+                ino_t inode;
+                long long int modification_ms;
+                unsigned long long size;
+
+                bool operator==(const key &other) const {
+                    return inode == other.inode && device == other.device
+                           && modification_ms == other.modification_ms && size == other.size;
+                }
+            };
+
+            struct key_hash {
+                std::size_t operator()(const key &k) const;
+            };
+
+            struct entry {
+                boost::uint64_t hash;
+                bool pending;
+            };
+
+            void compute(const cached_file_ptr &file, const key &k);
+
+            void store(const key &k, boost::uint64_t hash);
+
+            void discard(const key &k);
+
+            void make_room();
+
+            std::size_t max_entries_;
+
+            boost::mutex mutex_;
+
+            boost::unordered_map<key, entry, key_hash> entries_;
+
+            std::FILE *index_file_;
+
+            boost::asio::thread_pool pool_;
+        };
+
+    }
+}
+
+#endif
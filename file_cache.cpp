@@ -0,0 +1,176 @@
+#include "file_cache.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/locks.hpp>
+#include "mime_types.hpp"
+
+namespace http {
+    namespace server3 {
+
+        namespace {
+            const std::size_t eviction_samples = 8;
+
+            long long int modification_ms(const struct stat &info) {
+#if defined(__APPLE__)
+                return info.st_mtimespec.tv_sec * 1000LL + info.st_mtimespec.tv_nsec / 1000000;
+#else
+                return info.st_mtim.tv_sec * 1000LL + info.st_mtim.tv_nsec / 1000000;
+#endif
+            }
+
+            bool same_file(const cached_file &entry, const struct stat &info) {
+                return entry.inode == info.st_ino && entry.device == info.st_dev
+                       && entry.size == static_cast<unsigned long long>(info.st_size)
+                       && entry.modification_ms == modification_ms(info);
+            }
+        }
+
+        file_cache::file_cache(std::size_t max_entries, std::chrono::milliseconds ttl)
+                : max_entries_per_shard_(max_entries / shard_count > 0 ? max_entries / shard_count : 1),
+                  ttl_(ttl),
+                  watched_(false) {
+        }
+
+        cached_file_ptr file_cache::open(const std::string &path, const std::string &extension) {
+            shard &s = shard_for(path);
+            cached_file_ptr entry;
+            unsigned long long generation;
+            {
+                boost::shared_lock<boost::shared_mutex> lock(s.mutex);
+                boost::unordered_map<std::string, cached_file_ptr>::const_iterator it = s.entries.find(path);
+                if (it != s.entries.end())
+                    entry = it->second;
+                generation = s.generation;
+            }
+
+            if (entry && (watched_.load(std::memory_order_relaxed)
+                          || std::chrono::steady_clock::now() - entry->validated < ttl_))
+                return entry;
+
+            cached_file_ptr fresh = load(path, extension, entry);
+            if (!fresh) {
+                if (entry)
+                    invalidate(path);
+                return fresh;
+            }
+            store(s, path, fresh, generation);
+            return fresh;
+        }
+
+        cached_file_ptr file_cache::invalidate(const std::string &path) {
+            shard &s = shard_for(path);
+            boost::unique_lock<boost::shared_mutex> lock(s.mutex);
+            ++s.generation;
+            boost::unordered_map<std::string, cached_file_ptr>::iterator it = s.entries.find(path);
+            if (it == s.entries.end())
+                return cached_file_ptr();
+            cached_file_ptr removed = it->second;
+            s.entries.erase(it);
+            return removed;
+        }
+
+        std::vector<cached_file_ptr> file_cache::invalidate_tree(const std::string &directory) {
+            std::string prefix = directory + "/";
+            std::vector<cached_file_ptr> removed;
+            for (std::size_t i = 0; i < shard_count; ++i) {
+                boost::unique_lock<boost::shared_mutex> lock(shards_[i].mutex);
+                ++shards_[i].generation;
+                for (boost::unordered_map<std::string, cached_file_ptr>::iterator it = shards_[i].entries.begin();
+                     it != shards_[i].entries.end();) {
+                    if (it->first.compare(0, prefix.size(), prefix) == 0) {
+                        removed.push_back(it->second);
+                        it = shards_[i].entries.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            return removed;
+        }
+
+        void file_cache::set_watched(bool watched) {
+            watched_.store(watched, std::memory_order_relaxed);
+        }
+
+        file_cache::shard &file_cache::shard_for(const std::string &path) {
+            return shards_[boost::hash<std::string>()(path) % shard_count];
+        }
+
+        cached_file_ptr file_cache::load(const std::string &path, const std::string &extension,
+                                         const cached_file_ptr &previous) {
+            boost::shared_ptr<cached_file> entry = load_file(path, previous);
+            if (!entry)
+                return entry;
+
+            if (!previous || entry->file != previous->file)
+                entry->content_type = mime_types::extension_to_type(extension).to_string();
+            if (extension != "br" && extension != "gz") {
+                entry->brotli = load_sidecar(path + ".br", *entry, previous ? previous->brotli : cached_file_ptr());
+                entry->gzip = load_sidecar(path + ".gz", *entry, previous ? previous->gzip : cached_file_ptr());
+            }
+            return entry;
+        }
+
+        boost::shared_ptr<cached_file> file_cache::load_file(const std::string &path, const cached_file_ptr &previous) {
+            struct stat info;
+            if (previous) {
+                if (::stat(path.c_str(), &info) == 0 && same_file(*previous, info)) {
+                    boost::shared_ptr<cached_file> revalidated(new cached_file(*previous));
+                    revalidated->validated = std::chrono::steady_clock::now();
+                    return revalidated;
+                }
+            }
+
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return boost::shared_ptr<cached_file>();
+            file_descriptor_ptr file(new file_descriptor(fd));
+
+            if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+                return boost::shared_ptr<cached_file>();
+
+            boost::shared_ptr<cached_file> entry(new cached_file());
+            entry->file = file;
+            entry->size = info.st_size;
+            entry->modification_ms = modification_ms(info);
+            entry->device = info.st_dev;
+            entry->inode = info.st_ino;
+            entry->validated = std::chrono::steady_clock::now();
+            return entry;
+        }
+
+        cached_file_ptr file_cache::load_sidecar(const std::string &path, const cached_file &original,
+                                                 const cached_file_ptr &previous) {
+            boost::shared_ptr<cached_file> sidecar = load_file(path, previous);
+            if (!sidecar || sidecar->modification_ms < original.modification_ms)
+                return cached_file_ptr();
+            sidecar->content_type = original.content_type;
+            return sidecar;
+        }
+
+        void file_cache::store(shard &s, const std::string &path, const cached_file_ptr &entry,
+                               unsigned long long generation) {
+            boost::unique_lock<boost::shared_mutex> lock(s.mutex);
+            if (s.generation != generation)
+                return;
+            boost::unordered_map<std::string, cached_file_ptr>::iterator it = s.entries.find(path);
+            if (it != s.entries.end()) {
+                it->second = entry;
+                return;
+            }
+
+            if (s.entries.size() >= max_entries_per_shard_) {
+                boost::unordered_map<std::string, cached_file_ptr>::iterator victim = s.entries.begin();
+                boost::unordered_map<std::string, cached_file_ptr>::iterator candidate = victim;
+                for (std::size_t i = 0; i < eviction_samples && candidate != s.entries.end(); ++i, ++candidate) {
+                    if (candidate->second->validated < victim->second->validated)
+                        victim = candidate;
+                }
+                s.entries.erase(victim);
+            }
+            s.entries.emplace(path, entry);
+        }
+
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef HTTP_SERVER3_FILE_CACHE_HPP
+#define HTTP_SERVER3_FILE_CACHE_HPP
+
+#include <atomic>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <sys/types.h>
+#include <boost/array.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include "file_descriptor.hpp"
+
+namespace http {
+    namespace server3 {
+
+        struct cached_file {
+            file_descriptor_ptr file;
+            unsigned long long size;
+            long long int modification_ms;
+            dev_t device;
+            ino_t inode;
+            std::string content_type;
+            std::chrono::steady_clock::time_point validated;
+            boost::shared_ptr<const cached_file> brotli;
+            boost::shared_ptr<const cached_file> gzip;
+        };
+
+        typedef boost::shared_ptr<const cached_file> cached_file_ptr;
+
+        class file_cache : private boost::noncopyable {
+        public:
+            explicit file_cache(std::size_t max_entries = 4096,
+                                std::chrono::milliseconds ttl = std::chrono::milliseconds(2000));
+
+            cached_file_ptr open(const std::string &path, const std::string &extension);
+
+            cached_file_ptr invalidate(const std::string &path);
+
+            std::vector<cached_file_ptr> invalidate_tree(const std::string &directory);
+
+            void set_watched(bool watched);
+
+        private:
+            static const std::size_t shard_count = 16;
+
+            struct shard {
+                shard() : generation(0) {}
+
+                boost::shared_mutex mutex;
+                boost::unordered_map<std::string, cached_file_ptr> entries;
+                unsigned long long generation;
+            };
+
+            shard &shard_for(const std::string &path);
+
+            cached_file_ptr load(const std::string &path, const std::string &extension,
+                                 const cached_file_ptr &previous);
+
+            static boost::shared_ptr<cached_file> load_file(const std::string &path, const cached_file_ptr &previous);
+
+            static cached_file_ptr load_sidecar(const std::string &path, const cached_file &original,
+                                                const cached_file_ptr &previous);
+
+            void store(shard &s, const std::string &path, const cached_file_ptr &entry, unsigned long long generation);
+
+            std::size_t max_entries_per_shard_;
+
+            std::chrono::steady_clock::duration ttl_;
+
+            std::atomic<bool> watched_;
+
+            boost::array<shard, shard_count> shards_;
+        };
+
+    }
+}
+
+#endif
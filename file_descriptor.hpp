@@ -0,0 +1,33 @@
+#ifndef HTTP_SERVER3_FILE_DESCRIPTOR_HPP
+#define HTTP_SERVER3_FILE_DESCRIPTOR_HPP
+
+#include <unistd.h>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace http {
+    namespace server3 {
+
+        class file_descriptor : private boost::noncopyable {
+        public:
+            explicit file_descriptor(int fd) : fd_(fd) {}
+
+            ~file_descriptor() {
+                if (fd_ >= 0)
+                    ::close(fd_);
+            }
+
+            int native_handle() const {
+                return fd_;
+            }
+
+        private:
+            int fd_;
+        };
+
+        typedef boost::shared_ptr<file_descriptor> file_descriptor_ptr;
+
+    }
+}
+
+#endif
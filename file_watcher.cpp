@@ -0,0 +1,185 @@
+#include "file_watcher.hpp"
+#include <cerrno>
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include "logging.hpp"
+
+#if defined(__linux__)
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+namespace http {
+    namespace server3 {
+
+#if defined(__linux__)
+        namespace {
+            const unsigned int watch_mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE
+                                            | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF
+                                            | IN_ONLYDIR;
+
+            bool under(const std::string &path, const std::string &directory) {
+                return path.size() >= directory.size() && path.compare(0, directory.size(), directory) == 0
+                       && (path.size() == directory.size() || path[directory.size()] == '/');
+            }
+        }
+
+        file_watcher::file_watcher(const std::string &root, const change_handler &on_change,
+                                   const degraded_handler &on_degraded)
+                : root_(root),
+                  on_change_(on_change),
+                  on_degraded_(on_degraded),
+                  inotify_fd_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+                  wake_fd_(::eventfd(0, EFD_CLOEXEC)),
+                  complete_(false) {
+            if (inotify_fd_ < 0 || wake_fd_ < 0) {
+                HTTP_SERVER3_LOG(warning, "inotify unavailable (" << std::strerror(errno)
+                                          << "), revalidating cached files periodically");
+                return;
+            }
+            if (!watch_tree(root_)) {
+                HTTP_SERVER3_LOG(warning, "Cannot watch every directory under " << root_
+                                          << ", revalidating cached files periodically");
+                ::close(inotify_fd_);
+                inotify_fd_ = -1;
+                return;
+            }
+            complete_.store(true, std::memory_order_release);
+            HTTP_SERVER3_LOG(info, "Watching " << directories_.size() << " directories under " << root_);
+            thread_.reset(new boost::thread(&file_watcher::run, this));
+        }
+
+        file_watcher::~file_watcher() {
+            if (thread_) {
+                boost::uint64_t one = 1;
+                ssize_t written = ::write(wake_fd_, &one, sizeof(one));
+                (void) written;
+                thread_->join();
+            }
+            if (inotify_fd_ >= 0)
+                ::close(inotify_fd_);
+            if (wake_fd_ >= 0)
+                ::close(wake_fd_);
+        }
+
+        void file_watcher::run() {
+            alignas(inotify_event) char buffer[64 * 1024];
+            pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+            while (true) {
+                if (::poll(fds, 2, -1) < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    degrade(std::string("poll failed: ") + std::strerror(errno));
+                    return;
+                }
+                if (fds[1].revents)
+                    return;
+
+                ssize_t n;
+                while ((n = ::read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+                    for (char *p = buffer; p < buffer + n;) {
+                        const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+                        handle_event(event->wd, event->mask, event->len > 0 ? event->name : "");
+                        p += sizeof(inotify_event) + event->len;
+                    }
+                }
+            }
+        }
+
+        void file_watcher::handle_event(int wd, unsigned int mask, const char *name) {
+            if (mask & IN_Q_OVERFLOW) {
+                HTTP_SERVER3_LOG(warning, "inotify queue overflowed, dropping every cached file");
+                on_change_(root_, true);
+                return;
+            }
+
+            boost::unordered_map<int, std::string>::iterator it = directories_.find(wd);
+            if (it == directories_.end())
+                return;
+            if (mask & IN_IGNORED) {
+                directories_.erase(it);
+                return;
+            }
+            if (*name == '\0') {
+                if ((mask & (IN_DELETE_SELF | IN_MOVE_SELF)) && it->second == root_)
+                    degrade("document root was moved or deleted");
+                return;
+            }
+
+            std::string path = it->second + "/" + name;
+            HTTP_SERVER3_LOG(debug, "File system change: " << path);
+            if (!(mask & IN_ISDIR)) {
+                on_change_(path, false);
+                return;
+            }
+            if (mask & (IN_DELETE | IN_MOVED_FROM))
+                unwatch_tree(path);
+            if ((mask & (IN_CREATE | IN_MOVED_TO)) && complete() && !watch_tree(path))
+                degrade("cannot watch new directory " + path);
+            on_change_(path, true);
+        }
+
+        bool file_watcher::watch_tree(const std::string &directory) {
+            int wd = ::inotify_add_watch(inotify_fd_, directory.c_str(), watch_mask);
+            if (wd < 0) {
+                HTTP_SERVER3_LOG(warning, "inotify_add_watch " << directory << ": " << std::strerror(errno));
+                return false;
+            }
+            directories_[wd] = directory;
+
+            boost::system::error_code ec;
+            for (boost::filesystem::directory_iterator entry(directory, ec), end; !ec && entry != end;
+                 entry.increment(ec)) {
+                boost::filesystem::file_status status = entry->symlink_status(ec);
+                if (ec)
+                    break;
+                if (boost::filesystem::is_symlink(status)) {
+                    HTTP_SERVER3_LOG(warning, "Symbolic link " << entry->path().string() << " cannot be watched");
+                    return false;
+                }
+                if (boost::filesystem::is_directory(status) && !watch_tree(directory + "/" +
+                                                                           entry->path().filename().string()))
+                    return false;
+            }
+            return !ec;
+        }
+
+        void file_watcher::unwatch_tree(const std::string &directory) {
+            for (boost::unordered_map<int, std::string>::iterator it = directories_.begin();
+                 it != directories_.end();) {
+                if (under(it->second, directory)) {
+                    ::inotify_rm_watch(inotify_fd_, it->first);
+                    it = directories_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        void file_watcher::degrade(const std::string &reason) {
+            if (!complete_.exchange(false, std::memory_order_acq_rel))
+                return;
+            HTTP_SERVER3_LOG(warning, "File watching degraded (" << reason
+                                      << "), revalidating cached files periodically");
+            on_degraded_();
+        }
+#else
+        file_watcher::file_watcher(const std::string &root, const change_handler &on_change,
+                                   const degraded_handler &on_degraded)
+                : root_(root),
+                  on_change_(on_change),
+                  on_degraded_(on_degraded),
+                  inotify_fd_(-1),
+                  wake_fd_(-1),
+                  complete_(false) {
+        }
+
+        file_watcher::~file_watcher() {
+        }
+#endif
+
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef HTTP_SERVER3_FILE_WATCHER_HPP
+#define HTTP_SERVER3_FILE_WATCHER_HPP
+
+#include <atomic>
+#include <string>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace http {
+    namespace server3 {
+
+        class file_watcher : private boost::noncopyable {
+        public:
+            typedef boost::function<void(const std::string &path, bool tree)> change_handler;
+
+            typedef boost::function<void()> degraded_handler;
+
+            file_watcher(const std::string &root, const change_handler &on_change,
+                         const degraded_handler &on_degraded);
+
+            ~file_watcher();
+
+            bool complete() const {
+                return complete_.load(std::memory_order_acquire);
+            }
+
+        private:
+            void run();
+
+            void handle_event(int wd, unsigned int mask, const char *name);
+
+            bool watch_tree(const std::string &directory);
+
+            void unwatch_tree(const std::string &directory);
+
+            void degrade(const std::string &reason);
+
+            std::string root_;
+
+            change_handler on_change_;
+
+            degraded_handler on_degraded_;
+
+            int inotify_fd_;
+
+            int wake_fd_;
+
+            boost::unordered_map<int, std::string> directories_;
+
+            std::atomic<bool> complete_;
+
+            boost::scoped_ptr<boost::thread> thread_;
+        };
+
+    }
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef HTTP_SERVER3_HANDLER_ALLOCATOR_HPP
+#define HTTP_SERVER3_HANDLER_ALLOCATOR_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace http {
+    namespace server3 {
+
+        class handler_memory : private boost::noncopyable {
+        public:
+            handler_memory() {
+                for (std::size_t i = 0; i < slot_count; ++i)
+                    in_use_[i].store(false, std::memory_order_relaxed);
+            }
+
+            void *allocate(std::size_t size) {
+                if (size <= slot_size) {
+                    for (std::size_t i = 0; i < slot_count; ++i) {
+                        if (!in_use_[i].load(std::memory_order_relaxed)
+                            && !in_use_[i].exchange(true, std::memory_order_acquire))
+                            return &storage_[i];
+                    }
+                }
+                return ::operator new(size);
+            }
+
+            void deallocate(void *pointer) {
+                for (std::size_t i = 0; i < slot_count; ++i) {
+                    if (pointer == &storage_[i]) {
+                        in_use_[i].store(false, std::memory_order_release);
+                        return;
+                    }
+                }
+                ::operator delete(pointer);
+            }
+
+        private:
+            static const std::size_t slot_count = 4;
+
+            static const std::size_t slot_size = 512;
+
+            typename std::aligned_storage<slot_size>::type storage_[slot_count];
+
+            std::atomic<bool> in_use_[slot_count];
+        };
+
+        template<typename T>
+        class handler_allocator {
+        public:
+            typedef T value_type;
+
+            explicit handler_allocator(handler_memory &memory) : memory_(memory) {}
+
+            template<typename U>
+            handler_allocator(const handler_allocator<U> &other) : memory_(other.memory_) {}
+
+            bool operator==(const handler_allocator &other) const {
+                return &memory_ == &other.memory_;
+            }
+
+            bool operator!=(const handler_allocator &other) const {
+                return &memory_ != &other.memory_;
+            }
+
+            T *allocate(std::size_t n) const {
+                return static_cast<T *>(memory_.allocate(sizeof(T) * n));
+            }
+
+            void deallocate(T *pointer, std::size_t) const {
+                memory_.deallocate(pointer);
+            }
+
+        private:
+            template<typename>
+            friend class handler_allocator;
+
+            handler_memory &memory_;
+        };
+
+        template<typename Handler>
+        class custom_alloc_handler {
+        public:
+            typedef handler_allocator<Handler> allocator_type;
+
+            custom_alloc_handler(handler_memory &memory, Handler handler) : memory_(memory), handler_(handler) {}
+
+            allocator_type get_allocator() const {
+                return allocator_type(memory_);
+            }
+
+            template<typename... Args>
+            void operator()(Args &&... args) {
+                handler_(std::forward<Args>(args)...);
+            }
+
+        private:
+            handler_memory &memory_;
+
+            Handler handler_;
+        };
+
+        template<typename Handler>
+        inline custom_alloc_handler<Handler> make_custom_alloc_handler(handler_memory &memory, Handler handler) {
+            return custom_alloc_handler<Handler>(memory, handler);
+        }
+
+        class block_recycler : private boost::noncopyable {
+        public:
+            static const std::size_t block_size = 128;
+
+            static void *allocate(std::size_t size) {
+                if (size <= block_size) {
+                    std::vector<void *> &blocks = local().blocks_;
+                    if (!blocks.empty()) {
+                        void *block = blocks.back();
+                        blocks.pop_back();
+                        return block;
+                    }
+                    return ::operator new(block_size);
+                }
+                return ::operator new(size);
+            }
+
+            static void deallocate(void *pointer, std::size_t size) {
+                if (size <= block_size) {
+                    std::vector<void *> &blocks = local().blocks_;
+                    if (blocks.size() < max_blocks) {
+                        blocks.push_back(pointer);
+                        return;
+                    }
+                }
+                ::operator delete(pointer);
+            }
+
+        private:
+            static const std::size_t max_blocks = 4096;
+
+            block_recycler() {
+                blocks_.reserve(max_blocks);
+            }
+
+            ~block_recycler() {
+                for (std::size_t i = 0; i < blocks_.size(); ++i)
+                    ::operator delete(blocks_[i]);
+            }
+
+            static block_recycler &local() {
+                thread_local block_recycler recycler;
+                return recycler;
+            }
+
+            std::vector<void *> blocks_;
+        };
+
+        template<typename T>
+        class recycling_allocator {
+        public:
+            typedef T value_type;
+
+            recycling_allocator() {}
+
+            template<typename U>
+            recycling_allocator(const recycling_allocator<U> &) {}
+
+            bool operator==(const recycling_allocator &) const {
+                return true;
+            }
+
+            bool operator!=(const recycling_allocator &) const {
+                return false;
+            }
+
+            T *allocate(std::size_t n) const {
+                return static_cast<T *>(block_recycler::allocate(sizeof(T) * n));
+            }
+
+            void deallocate(T *pointer, std::size_t n) const {
+                block_recycler::deallocate(pointer, sizeof(T) * n);
+            }
+        };
+
+    }
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define HTTP_SERVER3_HEADER_HPP
 
 #include <string>
+#include <boost/utility/string_view.hpp>
 
 namespace http {
     namespace server3 {
@@ -9,6 +10,11 @@ namespace http {
             std::string name;
             std::string value;
         };
+
+        struct request_header {
+            boost::string_view name;
+            boost::string_view value;
+        };
     }
 }
 
@@ -0,0 +1,382 @@
+#include "hpack.hpp"
+#include <algorithm>
+#include <boost/cstdint.hpp>
+
+namespace http {
+    namespace server3 {
+        namespace hpack {
+
+            namespace {
+                struct static_entry {
+                    const char *name;
+                    const char *value;
+                };
+
+                const std::size_t static_table_size = 61;
+
+                const std::size_t entry_overhead = 32;
+
+                const boost::uint32_t huffman_codes[256] = {
+                    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+                    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+                    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+                    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+                    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+                    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+                    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+                    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+                    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+                    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+                    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+                    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+                    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+                    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+                    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+                    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+                    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+                    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+                    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+                    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+                    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+                    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+                    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+                    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+                    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+                    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+                    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+                    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+                    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+                    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+                    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+                    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee
+                };
+
+                const unsigned char huffman_lengths[256] = {
+                    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+                    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+                    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+                    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+                    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+                    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+                    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+                    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+                    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+                    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+                    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+                    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+                    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+                    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+                    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+                    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26
+                };
+
+                const static_entry static_table[static_table_size] = {
+                    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"},
+                    {":path", "/index.html"}, {":scheme", "http"}, {":scheme", "https"}, {":status", "200"},
+                    {":status", "204"}, {":status", "206"}, {":status", "304"}, {":status", "400"},
+                    {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+                    {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""},
+                    {"accept", ""}, {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""},
+                    {"authorization", ""}, {"cache-control", ""}, {"content-disposition", ""},
+                    {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+                    {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""},
+                    {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""},
+                    {"if-match", ""}, {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+                    {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""}, {"location", ""},
+                    {"max-forwards", ""}, {"proxy-authenticate", ""}, {"proxy-authorization", ""}, {"range", ""},
+                    {"referer", ""}, {"refresh", ""}, {"retry-after", ""}, {"server", ""}, {"set-cookie", ""},
+                    {"strict-transport-security", ""}, {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""},
+                    {"via", ""}, {"www-authenticate", ""}
+                };
+
+                struct huffman_node {
+                    short child[2];
+                    short symbol;
+                };
+
+                std::vector<huffman_node> build_huffman_tree() {
+                    huffman_node root = {{-1, -1}, -1};
+                    std::vector<huffman_node> nodes(1, root);
+                    for (int symbol = 0; symbol < 256; ++symbol) {
+                        int node = 0;
+                        for (int bit = huffman_lengths[symbol] - 1; bit >= 0; --bit) {
+                            int branch = (huffman_codes[symbol] >> bit) & 1;
+                            if (nodes[node].child[branch] < 0) {
+                                nodes[node].child[branch] = static_cast<short>(nodes.size());
+                                nodes.push_back(root);
+                            }
+                            node = nodes[node].child[branch];
+                        }
+                        nodes[node].symbol = static_cast<short>(symbol);
+                    }
+                    return nodes;
+                }
+
+                const std::vector<huffman_node> &huffman_tree() {
+                    static const std::vector<huffman_node> tree = build_huffman_tree();
+                    return tree;
+                }
+
+                std::vector<header> build_static_headers() {
+                    std::vector<header> headers(static_table_size);
+                    for (std::size_t i = 0; i < static_table_size; ++i) {
+                        headers[i].name = static_table[i].name;
+                        headers[i].value = static_table[i].value;
+                    }
+                    return headers;
+                }
+
+                const std::vector<header> &static_headers() {
+                    static const std::vector<header> headers = build_static_headers();
+                    return headers;
+                }
+
+                bool read_integer(const unsigned char *&data, const unsigned char *end, int prefix_bits,
+                                  std::size_t &value) {
+                    if (data == end)
+                        return false;
+                    std::size_t max_prefix = (1u << prefix_bits) - 1;
+                    value = *data++ & max_prefix;
+                    if (value < max_prefix)
+                        return true;
+                    for (unsigned int shift = 0; data != end && shift <= 28; shift += 7) {
+                        unsigned char b = *data++;
+                        value += static_cast<std::size_t>(b & 0x7f) << shift;
+                        if (!(b & 0x80))
+                            return true;
+                    }
+                    return false;
+                }
+
+                void write_integer(std::string &out, unsigned char first, int prefix_bits, std::size_t value) {
+                    std::size_t max_prefix = (1u << prefix_bits) - 1;
+                    if (value < max_prefix) {
+                        out += static_cast<char>(first | value);
+                        return;
+                    }
+                    out += static_cast<char>(first | max_prefix);
+                    for (value -= max_prefix; value >= 128; value /= 128)
+                        out += static_cast<char>(value % 128 + 128);
+                    out += static_cast<char>(value);
+                }
+
+                void write_string(std::string &out, boost::string_view value) {
+                    write_integer(out, 0, 7, value.size());
+                    out.append(value.data(), value.size());
+                }
+
+                std::size_t entry_size(boost::string_view name, boost::string_view value) {
+                    return name.size() + value.size() + entry_overhead;
+                }
+            }
+
+            table::table(std::size_t max_size)
+                    : size_(0),
+                      max_size_(max_size) {
+            }
+
+            const header *table::get(std::size_t index) const {
+                if (index == 0)
+                    return 0;
+                if (index <= static_table_size)
+                    return &static_headers()[index - 1];
+                index -= static_table_size + 1;
+                return index < entries_.size() ? &entries_[index] : 0;
+            }
+
+            std::size_t table::find(boost::string_view name, boost::string_view value, bool &exact) const {
+                std::size_t name_match = 0;
+                exact = false;
+                const std::vector<header> &statics = static_headers();
+                for (std::size_t i = 0; i < static_table_size; ++i) {
+                    if (statics[i].name != name)
+                        continue;
+                    if (statics[i].value == value) {
+                        exact = true;
+                        return i + 1;
+                    }
+                    if (!name_match)
+                        name_match = i + 1;
+                }
+                for (std::size_t i = 0; i < entries_.size(); ++i) {
+                    if (entries_[i].name != name)
+                        continue;
+                    if (entries_[i].value == value) {
+                        exact = true;
+                        return i + static_table_size + 1;
+                    }
+                    if (!name_match)
+                        name_match = i + static_table_size + 1;
+                }
+                return name_match;
+            }
+
+            void table::insert(boost::string_view name, boost::string_view value) {
+                std::size_t size = entry_size(name, value);
+                if (size > max_size_) {
+                    entries_.clear();
+                    size_ = 0;
+                    return;
+                }
+                evict(size);
+                header entry;
+                entry.name.assign(name.data(), name.size());
+                entry.value.assign(value.data(), value.size());
+                entries_.push_front(entry);
+                size_ += size;
+            }
+
+            void table::resize(std::size_t max_size) {
+                max_size_ = max_size;
+                evict(0);
+            }
+
+            void table::evict(std::size_t required) {
+                while (!entries_.empty() && size_ + required > max_size_) {
+                    size_ -= entry_size(entries_.back().name, entries_.back().value);
+                    entries_.pop_back();
+                }
+            }
+
+            decoder::decoder(std::size_t max_list_size)
+                    : max_list_size_(max_list_size),
+                      list_size_(0),
+                      oversized_(false) {
+            }
+
+            bool decoder::decode(const unsigned char *data, std::size_t size, std::vector<header> &headers) {
+                const unsigned char *end = data + size;
+                list_size_ = 0;
+                oversized_ = false;
+                std::string name, value;
+                while (data != end) {
+                    unsigned char first = *data;
+                    std::size_t index;
+                    if (first & 0x80) {
+                        const header *entry = read_integer(data, end, 7, index) ? table_.get(index) : 0;
+                        if (!entry || !emit(entry->name, entry->value, headers))
+                            return false;
+                        continue;
+                    }
+                    if ((first & 0xe0) == 0x20) {
+                        if (!read_integer(data, end, 5, index) || index > default_table_size)
+                            return false;
+                        table_.resize(index);
+                        continue;
+                    }
+
+                    bool indexed = (first & 0xc0) == 0x40;
+                    if (!read_integer(data, end, indexed ? 6 : 4, index))
+                        return false;
+                    if (index) {
+                        const header *entry = table_.get(index);
+                        if (!entry)
+                            return false;
+                        name = entry->name;
+                    } else if (!read_string(data, end, name)) {
+                        return false;
+                    }
+                    if (!read_string(data, end, value) || !emit(name, value, headers))
+                        return false;
+                    if (indexed)
+                        table_.insert(name, value);
+                }
+                return true;
+            }
+
+            bool decoder::read_string(const unsigned char *&data, const unsigned char *end, std::string &out) {
+                if (data == end)
+                    return false;
+                bool huffman = (*data & 0x80) != 0;
+                std::size_t length;
+                if (!read_integer(data, end, 7, length) || length > static_cast<std::size_t>(end - data))
+                    return false;
+                out.clear();
+                if (huffman) {
+                    if (!huffman_decode(data, length, out))
+                        return false;
+                } else {
+                    out.assign(reinterpret_cast<const char *>(data), length);
+                }
+                data += length;
+                return true;
+            }
+
+            bool decoder::emit(boost::string_view name, boost::string_view value, std::vector<header> &headers) {
+                list_size_ += entry_size(name, value);
+                if (list_size_ > max_list_size_) {
+                    oversized_ = true;
+                    return true;
+                }
+                header h;
+                h.name.assign(name.data(), name.size());
+                h.value.assign(value.data(), value.size());
+                headers.push_back(h);
+                return true;
+            }
+
+            encoder::encoder()
+                    : smallest_size_(default_table_size),
+                      size_changed_(false) {
+            }
+
+            void encoder::set_max_table_size(std::size_t size) {
+                size = std::min(size, default_table_size);
+                if (size == table_.max_size())
+                    return;
+                table_.resize(size);
+                smallest_size_ = size_changed_ ? std::min(smallest_size_, size) : size;
+                size_changed_ = true;
+            }
+
+            void encoder::begin(std::string &out) {
+                if (!size_changed_)
+                    return;
+                if (smallest_size_ < table_.max_size())
+                    write_integer(out, 0x20, 5, smallest_size_);
+                write_integer(out, 0x20, 5, table_.max_size());
+                size_changed_ = false;
+            }
+
+            void encoder::encode(boost::string_view name, boost::string_view value, bool index, std::string &out) {
+                bool exact;
+                std::size_t i = table_.find(name, value, exact);
+                if (exact) {
+                    write_integer(out, 0x80, 7, i);
+                    return;
+                }
+                write_integer(out, index ? 0x40 : 0x00, index ? 6 : 4, i);
+                if (!i)
+                    write_string(out, name);
+                write_string(out, value);
+                if (index)
+                    table_.insert(name, value);
+            }
+
+            bool huffman_decode(const unsigned char *data, std::size_t size, std::string &out) {
+                const std::vector<huffman_node> &tree = huffman_tree();
+                int node = 0;
+                unsigned int pending_bits = 0;
+                bool padding = true;
+                for (std::size_t i = 0; i < size; ++i) {
+                    for (int bit = 7; bit >= 0; --bit) {
+                        int branch = (data[i] >> bit) & 1;
+                        node = tree[node].child[branch];
+                        if (node < 0)
+                            return false;
+                        ++pending_bits;
+                        padding = padding && branch;
+                        if (tree[node].symbol >= 0) {
+                            out += static_cast<char>(tree[node].symbol);
+                            node = 0;
+                            pending_bits = 0;
+                            padding = true;
+                        }
+                    }
+                }
+                return pending_bits < 8 && padding;
+            }
+
+        }
+    }
+}
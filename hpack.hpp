@@ -0,0 +1,91 @@
+#ifndef HTTP_SERVER3_HPACK_HPP
+#define HTTP_SERVER3_HPACK_HPP
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/utility/string_view.hpp>
+#include "header.hpp"
+
+namespace http {
+    namespace server3 {
+        namespace hpack {
+
+            const std::size_t default_table_size = 4096;
+
+            class table : private boost::noncopyable {
+            public:
+                explicit table(std::size_t max_size = default_table_size);
+
+                const header *get(std::size_t index) const;
+
+                std::size_t find(boost::string_view name, boost::string_view value, bool &exact) const;
+
+                void insert(boost::string_view name, boost::string_view value);
+
+                void resize(std::size_t max_size);
+
+                std::size_t max_size() const {
+                    return max_size_;
+                }
+
+            private:
+                void evict(std::size_t required);
+
+                std::deque<header> entries_;
+
+                std::size_t size_;
+
+                std::size_t max_size_;
+            };
+
+            class decoder : private boost::noncopyable {
+            public:
+                explicit decoder(std::size_t max_list_size);
+
+                bool decode(const unsigned char *data, std::size_t size, std::vector<header> &headers);
+
+                bool oversized() const {
+                    return oversized_;
+                }
+
+            private:
+                bool read_string(const unsigned char *&data, const unsigned char *end, std::string &out);
+
+                bool emit(boost::string_view name, boost::string_view value, std::vector<header> &headers);
+
+                table table_;
+
+                std::size_t max_list_size_;
+
+                std::size_t list_size_;
+
+                bool oversized_;
+            };
+
+            class encoder : private boost::noncopyable {
+            public:
+                encoder();
+
+                void set_max_table_size(std::size_t size);
+
+                void begin(std::string &out);
+
+                void encode(boost::string_view name, boost::string_view value, bool index, std::string &out);
+
+            private:
+                table table_;
+
+                std::size_t smallest_size_;
+
+                bool size_changed_;
+            };
+
+            bool huffman_decode(const unsigned char *data, std::size_t size, std::string &out);
+
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,793 @@
+#include "http2_session.hpp"
+#include <algorithm>
+#include <boost/algorithm/string/case_conv.hpp>
+#include "http_date.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+
+namespace http {
+    namespace server3 {
+
+        namespace {
+            const char preface_data[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+            const std::size_t frame_header_size = 9;
+
+            const std::size_t default_frame_size = 16384;
+
+            const std::size_t max_peer_frame_size = 16777215;
+
+            const std::size_t max_header_block = 256 * 1024;
+
+            const std::size_t max_header_list_size = 65536;
+
+            const std::size_t max_concurrent_streams = 100;
+
+            const std::size_t max_output = 256 * 1024;
+
+            const std::size_t max_pending_acks = 1000;
+
+            const boost::int64_t default_window = 65535;
+
+            const boost::int64_t max_window = 0x7fffffff;
+
+            const unsigned int default_weight = 16;
+
+            enum frame_type {
+                frame_data, frame_headers, frame_priority, frame_rst_stream, frame_settings, frame_push_promise,
+                frame_ping, frame_goaway, frame_window_update, frame_continuation
+            };
+
+            enum frame_flag {
+                flag_end_stream = 0x1, flag_ack = 0x1, flag_end_headers = 0x4, flag_padded = 0x8, flag_priority = 0x20
+            };
+
+            enum error_code {
+                no_error, protocol_error, internal_error, flow_control_error, settings_timeout, stream_closed,
+                frame_size_error, refused_stream, cancel, compression_error, connect_error, enhance_your_calm
+            };
+
+            enum setting {
+                setting_header_table_size = 1, setting_enable_push, setting_max_concurrent_streams,
+                setting_initial_window_size, setting_max_frame_size, setting_max_header_list_size
+            };
+
+            boost::uint32_t read16(const unsigned char *p) {
+                return static_cast<boost::uint32_t>(p[0]) << 8 | p[1];
+            }
+
+            boost::uint32_t read24(const unsigned char *p) {
+                return static_cast<boost::uint32_t>(p[0]) << 16 | static_cast<boost::uint32_t>(p[1]) << 8 | p[2];
+            }
+
+            boost::uint32_t read32(const unsigned char *p) {
+                return static_cast<boost::uint32_t>(p[0]) << 24 | static_cast<boost::uint32_t>(p[1]) << 16
+                       | static_cast<boost::uint32_t>(p[2]) << 8 | p[3];
+            }
+
+            void append16(std::string &out, boost::uint32_t value) {
+                out += static_cast<char>(value >> 8 & 0xff);
+                out += static_cast<char>(value & 0xff);
+            }
+
+            void append32(std::string &out, boost::uint32_t value) {
+                append16(out, value >> 16);
+                append16(out, value & 0xffff);
+            }
+
+            void write_frame(std::string &out, std::size_t length, unsigned char type, unsigned char flags,
+                             boost::uint32_t id) {
+                out += static_cast<char>(length >> 16 & 0xff);
+                append16(out, static_cast<boost::uint32_t>(length & 0xffff));
+                out += static_cast<char>(type);
+                out += static_cast<char>(flags);
+                append32(out, id & 0x7fffffff);
+            }
+
+            bool connection_specific(boost::string_view name) {
+                return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+                       || name == "transfer-encoding" || name == "upgrade" || name == "http2-settings";
+            }
+
+            bool decode_base64url(boost::string_view in, std::string &out) {
+                unsigned int bits = 0, count = 0;
+                for (char c : in) {
+                    unsigned int value;
+                    if (c >= 'A' && c <= 'Z')
+                        value = c - 'A';
+                    else if (c >= 'a' && c <= 'z')
+                        value = c - 'a' + 26;
+                    else if (c >= '0' && c <= '9')
+                        value = c - '0' + 52;
+                    else if (c == '-' || c == '+')
+                        value = 62;
+                    else if (c == '_' || c == '/')
+                        value = 63;
+                    else if (c == '=')
+                        break;
+                    else
+                        return false;
+                    bits = (bits << 6 | value) & 0xffff;
+                    count += 6;
+                    if (count >= 8) {
+                        count -= 8;
+                        out += static_cast<char>(bits >> count & 0xff);
+                    }
+                }
+                return true;
+            }
+        }
+
+        const boost::string_view http2_session::preface(preface_data, sizeof(preface_data) - 1);
+
+        http2_session::stream::stream()
+                : id(0),
+                  parent(0),
+                  weight(default_weight),
+                  window(default_window),
+                  pass(0),
+                  next_piece(0),
+                  piece_sent(0),
+                  body_bytes(0),
+                  reserved(0),
+                  closed(false) {
+        }
+
+        http2_session::http2_session(request_handler &handler, admission_control *admission, bool first_request)
+                : request_handler_(handler),
+                  admission_(admission),
+                  first_request_(first_request),
+                  decoder_(max_header_list_size),
+                  preface_received_(false),
+                  settings_received_(false),
+                  flushing_(false),
+                  continuing_(0),
+                  continuing_flags_(0),
+                  priority_dependency_(0),
+                  priority_weight_(default_weight),
+                  priority_exclusive_(false),
+                  last_stream_id_(0),
+                  window_(default_window),
+                  initial_window_(default_window),
+                  max_frame_size_(default_frame_size),
+                  pass_(0),
+                  pending_acks_(0),
+                  resets_allowed_(max_concurrent_streams),
+                  goaway_sent_(false),
+                  goaway_received_(false) {
+            write_frame(frames_, 12, frame_settings, 0, 0);
+            append16(frames_, setting_max_concurrent_streams);
+            append32(frames_, max_concurrent_streams);
+            append16(frames_, setting_max_header_list_size);
+            append32(frames_, max_header_list_size);
+        }
+
+        http2_session::~http2_session() {
+            if (!admission_)
+                return;
+            for (stream_map::value_type &entry : streams_)
+                admission_->release(entry.second.reserved);
+        }
+
+        bool http2_session::upgrade(const request &req, boost::string_view settings) {
+            std::string payload;
+            if (!decode_base64url(settings, payload) || payload.size() % 6
+                || apply_settings(reinterpret_cast<const unsigned char *>(payload.data()), payload.size()))
+                return false;
+
+            stream &s = streams_[1];
+            s.id = last_stream_id_ = 1;
+            s.window = initial_window_;
+            s.start = std::chrono::steady_clock::now();
+            header h;
+            h.name = ":method";
+            h.value = req.method.to_string();
+            s.fields.push_back(h);
+            h.name = ":path";
+            h.value = req.uri.to_string();
+            s.fields.push_back(h);
+            for (const request_header &field : req.headers) {
+                h.name = boost::algorithm::to_lower_copy(field.name.to_string());
+                if (connection_specific(h.name))
+                    continue;
+                h.value = field.value.to_string();
+                s.fields.push_back(h);
+            }
+            dispatch(s);
+            return true;
+        }
+
+        void http2_session::consume(const char *data, std::size_t size) {
+            if (goaway_sent_)
+                return;
+
+            input_.append(data, size);
+            std::size_t offset = 0;
+            if (!preface_received_) {
+                if (preface.substr(0, input_.size()) != boost::string_view(input_).substr(0, preface.size())) {
+                    fail(protocol_error);
+                    return;
+                }
+                if (input_.size() < preface.size())
+                    return;
+                offset = preface.size();
+                preface_received_ = true;
+            }
+
+            while (input_.size() - offset >= frame_header_size) {
+                const unsigned char *header = reinterpret_cast<const unsigned char *>(input_.data()) + offset;
+                std::size_t length = read24(header);
+                if (length > default_frame_size) {
+                    fail(frame_size_error);
+                    break;
+                }
+                if (input_.size() - offset < frame_header_size + length)
+                    break;
+                if (!parse_frame(header, header + frame_header_size))
+                    break;
+                offset += frame_header_size + length;
+            }
+            input_.erase(0, offset);
+        }
+
+        bool http2_session::parse_frame(const unsigned char *header, const unsigned char *payload) {
+            std::size_t length = read24(header);
+            unsigned char type = header[3], flags = header[4];
+            boost::uint32_t id = read32(header + 5) & 0x7fffffff;
+            if (!settings_received_ && (type != frame_settings || (flags & flag_ack)))
+                return fail(protocol_error);
+            if (continuing_ && (type != frame_continuation || id != continuing_))
+                return fail(protocol_error);
+
+            switch (type) {
+                case frame_data: {
+                    if (id == 0 || id > last_stream_id_)
+                        return fail(protocol_error);
+                    if (length == 0)
+                        return true;
+                    write_window_update(0, static_cast<boost::uint32_t>(length));
+                    stream_map::iterator it = streams_.find(id);
+                    if (it == streams_.end())
+                        reset_stream(id, stream_closed);
+                    else if (!(flags & flag_end_stream))
+                        write_window_update(id, static_cast<boost::uint32_t>(length));
+                    return true;
+                }
+                case frame_headers:
+                    return handle_headers(id, flags, payload, length);
+                case frame_priority:
+                    return handle_priority(id, payload, length);
+                case frame_rst_stream: {
+                    if (id == 0 || id > last_stream_id_)
+                        return fail(protocol_error);
+                    if (length != 4)
+                        return fail(frame_size_error);
+                    stream_map::iterator it = streams_.find(id);
+                    if (it != streams_.end()) {
+                        metrics::record_event(metrics::http2_stream_reset);
+                        retire(it->second);
+                        if (resets_allowed_ == 0)
+                            return fail(enhance_your_calm);
+                        --resets_allowed_;
+                    }
+                    return true;
+                }
+                case frame_settings:
+                    if (id != 0)
+                        return fail(protocol_error);
+                    return handle_settings(flags, payload, length);
+                case frame_push_promise:
+                    return fail(protocol_error);
+                case frame_ping:
+                    if (id != 0)
+                        return fail(protocol_error);
+                    if (length != 8)
+                        return fail(frame_size_error);
+                    if (!(flags & flag_ack)) {
+                        if (++pending_acks_ > max_pending_acks)
+                            return fail(enhance_your_calm);
+                        write_frame(frames_, 8, frame_ping, flag_ack, 0);
+                        frames_.append(reinterpret_cast<const char *>(payload), 8);
+                    }
+                    return true;
+                case frame_goaway:
+                    if (id != 0)
+                        return fail(protocol_error);
+                    goaway_received_ = true;
+                    return true;
+                case frame_window_update:
+                    return handle_window_update(id, payload, length);
+                case frame_continuation:
+                    if (!continuing_)
+                        return fail(protocol_error);
+                    header_block_.append(reinterpret_cast<const char *>(payload), length);
+                    if (header_block_.size() > max_header_block)
+                        return fail(enhance_your_calm);
+                    return (flags & flag_end_headers) ? open_stream() : true;
+                default:
+                    return true;
+            }
+        }
+
+        bool http2_session::handle_headers(boost::uint32_t id, unsigned char flags, const unsigned char *payload,
+                                           std::size_t length) {
+            if (id == 0 || !(id & 1))
+                return fail(protocol_error);
+
+            std::size_t padding = 0;
+            if (flags & flag_padded) {
+                if (length < 1)
+                    return fail(frame_size_error);
+                padding = payload[0];
+                ++payload;
+                --length;
+            }
+            priority_dependency_ = 0;
+            priority_weight_ = default_weight;
+            priority_exclusive_ = false;
+            if (flags & flag_priority) {
+                if (length < 5)
+                    return fail(frame_size_error);
+                priority_dependency_ = read32(payload) & 0x7fffffff;
+                priority_exclusive_ = (payload[0] & 0x80) != 0;
+                priority_weight_ = payload[4] + 1u;
+                payload += 5;
+                length -= 5;
+            }
+            if (padding > length)
+                return fail(protocol_error);
+
+            header_block_.assign(reinterpret_cast<const char *>(payload), length - padding);
+            continuing_ = id;
+            continuing_flags_ = flags;
+            return (flags & flag_end_headers) ? open_stream() : true;
+        }
+
+        bool http2_session::open_stream() {
+            boost::uint32_t id = continuing_;
+            continuing_ = 0;
+            std::vector<header> fields;
+            if (!decoder_.decode(reinterpret_cast<const unsigned char *>(header_block_.data()), header_block_.size(),
+                                 fields))
+                return fail(compression_error);
+            header_block_.clear();
+
+            if (id <= last_stream_id_)
+                return streams_.count(id) ? true : fail(stream_closed);
+            last_stream_id_ = id;
+            if (decoder_.oversized()) {
+                reset_stream(id, enhance_your_calm);
+                return true;
+            }
+            if (streams_.size() >= max_concurrent_streams || goaway_received_) {
+                reset_stream(id, refused_stream);
+                return true;
+            }
+            if (priority_dependency_ == id) {
+                reset_stream(id, protocol_error);
+                return true;
+            }
+
+            stream &s = streams_[id];
+            s.id = id;
+            s.window = initial_window_;
+            s.pass = pass_;
+            s.start = std::chrono::steady_clock::now();
+            s.fields.swap(fields);
+            if (continuing_flags_ & flag_priority)
+                prioritize(s, priority_dependency_, priority_weight_, priority_exclusive_);
+            dispatch(s);
+            return true;
+        }
+
+        void http2_session::dispatch(stream &s) {
+            boost::string_view method, path;
+            bool malformed = false, regular = false;
+            for (const header &h : s.fields) {
+                if (!h.name.empty() && h.name[0] == ':') {
+                    if (h.name == ":method")
+                        method = h.value;
+                    else if (h.name == ":path")
+                        path = h.value;
+                    else if (h.name != ":scheme" && h.name != ":authority")
+                        malformed = true;
+                    malformed = malformed || regular;
+                    continue;
+                }
+                regular = true;
+                if (connection_specific(h.name) || std::any_of(h.name.begin(), h.name.end(), [](char c) {
+                    return c >= 'A' && c <= 'Z';
+                }))
+                    malformed = true;
+                request_header field;
+                field.name = h.name;
+                field.value = h.value;
+                s.req.headers.push_back(field);
+            }
+            if (malformed || method.empty() || path.empty()) {
+                reset_stream(s.id, protocol_error);
+                return;
+            }
+
+            s.req.method = method;
+            s.req.uri = path;
+            s.req.http_version_major = 2;
+            s.req.http_version_minor = 0;
+            bool first_request = first_request_;
+            first_request_ = false;
+            if (admission_ && !admission_->admit(first_request)) {
+                s.rep = reply::stock_reply(reply::service_unavailable);
+                header retry_after;
+                retry_after.name = "Retry-After";
+                retry_after.value = std::to_string(admission_->retry_after());
+                s.rep.headers.push_back(retry_after);
+            } else {
+                request_handler_.handle_request(s.req, s.rep);
+            }
+            respond(s);
+        }
+
+        void http2_session::respond(stream &s) {
+            reply &rep = s.rep;
+            std::string block;
+            encoder_.begin(block);
+            encoder_.encode(":status", std::to_string(rep.status), true, block);
+            for (const header &h : rep.headers) {
+                std::string name = boost::algorithm::to_lower_copy(h.name);
+                if (!connection_specific(name))
+                    encoder_.encode(name, h.value, name != "content-length" && name != "content-range", block);
+            }
+            encoder_.encode("date", http_date::now()->date, true, block);
+
+            if (s.req.method != "HEAD") {
+                std::vector<boost::asio::const_buffer> memory(1, boost::asio::buffer(rep.content));
+                memory.insert(memory.end(), rep.body_buffers.begin(), rep.body_buffers.end());
+                add_body(s, memory, rep.body_file ? rep.body_offset : 0, rep.body_file ? rep.body_length : 0);
+                for (const body_segment &segment : rep.body_segments)
+                    add_body(s, segment.buffers, segment.offset, segment.length);
+            }
+            for (const piece &p : s.body)
+                s.body_bytes += p.length;
+
+            bool end_stream = s.body.empty();
+            std::size_t offset = 0;
+            do {
+                std::size_t length = std::min(block.size() - offset, max_frame_size_);
+                unsigned char flags = offset + length == block.size() ? flag_end_headers : 0;
+                if (offset == 0 && end_stream)
+                    flags |= flag_end_stream;
+                write_frame(frames_, length, offset == 0 ? frame_headers : frame_continuation, flags, s.id);
+                frames_.append(block, offset, length);
+                offset += length;
+            } while (offset < block.size());
+
+            metrics::record_latency(metrics::time_to_first_byte, std::chrono::steady_clock::now() - s.start);
+            if (admission_) {
+                s.reserved = block.size() + s.body_bytes;
+                admission_->reserve(s.reserved);
+            }
+            if (end_stream) {
+                s.closed = true;
+                ending_.push_back(s.id);
+            }
+        }
+
+        void http2_session::add_body(stream &s, const std::vector<boost::asio::const_buffer> &memory,
+                                     unsigned long long offset, unsigned long long length) {
+            for (const boost::asio::const_buffer &b : memory) {
+                if (b.size() == 0)
+                    continue;
+                piece p = {b, 0, b.size(), false};
+                s.body.push_back(p);
+            }
+            if (length > 0) {
+                piece p = {boost::asio::const_buffer(), offset, length, true};
+                s.body.push_back(p);
+            }
+        }
+
+        void http2_session::prioritize(stream &s, boost::uint32_t dependency, unsigned int weight, bool exclusive) {
+            if (dependency && !streams_.count(dependency)) {
+                dependency = 0;
+                weight = default_weight;
+                exclusive = false;
+            }
+            if (dependency && descends(dependency, s.id))
+                streams_[dependency].parent = s.parent;
+            if (exclusive) {
+                for (stream_map::value_type &entry : streams_) {
+                    if (entry.first != s.id && entry.second.parent == dependency)
+                        entry.second.parent = s.id;
+                }
+            }
+            s.parent = dependency;
+            s.weight = weight;
+        }
+
+        bool http2_session::descends(boost::uint32_t id, boost::uint32_t ancestor) const {
+            for (std::size_t depth = 0; id && depth <= streams_.size(); ++depth) {
+                stream_map::const_iterator it = streams_.find(id);
+                if (it == streams_.end())
+                    return false;
+                if (it->second.parent == ancestor)
+                    return true;
+                id = it->second.parent;
+            }
+            return false;
+        }
+
+        bool http2_session::sendable(const stream &s) const {
+            return !s.closed && s.next_piece < s.body.size() && s.window > 0;
+        }
+
+        http2_session::stream *http2_session::schedule() {
+            stream *best = 0;
+            for (stream_map::value_type &entry : streams_) {
+                stream &s = entry.second;
+                if (!sendable(s))
+                    continue;
+                bool blocked = false;
+                boost::uint32_t parent = s.parent;
+                for (std::size_t depth = 0; parent && !blocked && depth < streams_.size(); ++depth) {
+                    stream_map::const_iterator it = streams_.find(parent);
+                    if (it == streams_.end())
+                        break;
+                    blocked = sendable(it->second);
+                    parent = it->second.parent;
+                }
+                if (!blocked && (!best || s.pass < best->pass))
+                    best = &s;
+            }
+            return best;
+        }
+
+        bool http2_session::data_pending() {
+            return !flushing_ && !goaway_sent_ && window_ > 0 && schedule() != 0;
+        }
+
+        bool http2_session::next_output(output &out, std::size_t budget) {
+            out.buffers.clear();
+            out.file.reset();
+            out.offset = 0;
+            out.length = 0;
+            if (flushing_)
+                return false;
+
+            sending_.swap(frames_);
+            frames_.clear();
+            pending_acks_ = 0;
+            sending_ending_.swap(ending_);
+            ending_.clear();
+            data_headers_.clear();
+            std::vector<boost::asio::const_buffer> payloads;
+            while (!goaway_sent_ && budget > 0 && window_ > 0 && !out.length) {
+                stream *s = schedule();
+                if (!s)
+                    break;
+                piece &p = s->body[s->next_piece];
+                unsigned long long remaining = p.length - s->piece_sent;
+                std::size_t length = std::min<unsigned long long>(remaining, std::min(s->window, window_));
+                length = std::min(length, std::min(max_frame_size_, budget));
+                bool last = s->next_piece + 1 == s->body.size() && length == remaining;
+                write_frame(data_headers_, length, frame_data, last ? flag_end_stream : 0, s->id);
+                if (p.file) {
+                    out.file = s->rep.body_file;
+                    out.offset = p.offset + s->piece_sent;
+                    out.length = length;
+                } else {
+                    payloads.push_back(boost::asio::buffer(static_cast<const char *>(p.memory.data()) + s->piece_sent,
+                                                           length));
+                }
+                s->piece_sent += length;
+                if (s->piece_sent == p.length) {
+                    ++s->next_piece;
+                    s->piece_sent = 0;
+                }
+                s->window -= length;
+                window_ -= length;
+                budget -= length;
+                pass_ = s->pass;
+                s->pass += length * 256 / s->weight + 1;
+                if (last) {
+                    s->closed = true;
+                    sending_ending_.push_back(s->id);
+                }
+            }
+
+            if (!sending_.empty())
+                out.buffers.push_back(boost::asio::buffer(sending_));
+            for (std::size_t i = 0; i < payloads.size(); ++i) {
+                out.buffers.push_back(boost::asio::buffer(data_headers_.data() + i * frame_header_size,
+                                                          frame_header_size));
+                out.buffers.push_back(payloads[i]);
+            }
+            if (out.length)
+                out.buffers.push_back(boost::asio::buffer(data_headers_.data() + payloads.size() * frame_header_size,
+                                                          frame_header_size));
+            if (out.buffers.empty())
+                return false;
+            flushing_ = true;
+            return true;
+        }
+
+        void http2_session::written() {
+            flushing_ = false;
+            sending_.clear();
+            for (boost::uint32_t id : sending_ending_) {
+                stream_map::iterator it = streams_.find(id);
+                if (it != streams_.end())
+                    complete(it->second);
+            }
+            sending_ending_.clear();
+            for (boost::uint32_t id : retired_)
+                erase(id);
+            retired_.clear();
+        }
+
+        bool http2_session::congested() const {
+            return frames_.size() >= max_output;
+        }
+
+        bool http2_session::finished() const {
+            return (goaway_sent_ || (goaway_received_ && streams_.empty())) && frames_.empty() && !flushing_;
+        }
+
+        bool http2_session::handle_priority(boost::uint32_t id, const unsigned char *payload, std::size_t length) {
+            if (id == 0)
+                return fail(protocol_error);
+            if (length != 5) {
+                reset_stream(id, frame_size_error);
+                return true;
+            }
+            boost::uint32_t dependency = read32(payload) & 0x7fffffff;
+            stream_map::iterator it = streams_.find(id);
+            if (it == streams_.end())
+                return true;
+            if (dependency == id) {
+                reset_stream(id, protocol_error);
+                return true;
+            }
+            prioritize(it->second, dependency, payload[4] + 1u, (payload[0] & 0x80) != 0);
+            return true;
+        }
+
+        bool http2_session::handle_settings(unsigned char flags, const unsigned char *payload, std::size_t length) {
+            if (flags & flag_ack)
+                return length == 0 ? true : fail(frame_size_error);
+            if (length % 6)
+                return fail(frame_size_error);
+            if (boost::uint32_t code = apply_settings(payload, length))
+                return fail(code);
+            settings_received_ = true;
+            if (++pending_acks_ > max_pending_acks)
+                return fail(enhance_your_calm);
+            write_frame(frames_, 0, frame_settings, flag_ack, 0);
+            return true;
+        }
+
+        boost::uint32_t http2_session::apply_settings(const unsigned char *payload, std::size_t length) {
+            for (std::size_t i = 0; i + 6 <= length; i += 6) {
+                boost::uint32_t value = read32(payload + i + 2);
+                switch (read16(payload + i)) {
+                    case setting_header_table_size:
+                        encoder_.set_max_table_size(value);
+                        break;
+                    case setting_enable_push:
+                        if (value > 1)
+                            return protocol_error;
+                        break;
+                    case setting_initial_window_size:
+                        if (value > max_window)
+                            return flow_control_error;
+                        for (stream_map::value_type &entry : streams_) {
+                            entry.second.window += value - initial_window_;
+                            if (entry.second.window > max_window)
+                                return flow_control_error;
+                        }
+                        initial_window_ = value;
+                        break;
+                    case setting_max_frame_size:
+                        if (value < default_frame_size || value > max_peer_frame_size)
+                            return protocol_error;
+                        max_frame_size_ = value;
+                        break;
+                    default:
+                        break;
+                }
+            }
+            return no_error;
+        }
+
+        bool http2_session::handle_window_update(boost::uint32_t id, const unsigned char *payload,
+                                                 std::size_t length) {
+            if (length != 4)
+                return fail(frame_size_error);
+            boost::uint32_t increment = read32(payload) & 0x7fffffff;
+            if (id == 0) {
+                if (increment == 0)
+                    return fail(protocol_error);
+                window_ += increment;
+                return window_ > max_window ? fail(flow_control_error) : true;
+            }
+            if (id > last_stream_id_)
+                return fail(protocol_error);
+
+            stream_map::iterator it = streams_.find(id);
+            if (it == streams_.end())
+                return true;
+            if (increment == 0) {
+                reset_stream(id, protocol_error);
+                return true;
+            }
+            it->second.window += increment;
+            if (it->second.window > max_window)
+                reset_stream(id, flow_control_error);
+            return true;
+        }
+
+        void http2_session::reset_stream(boost::uint32_t id, boost::uint32_t code) {
+            write_frame(frames_, 4, frame_rst_stream, 0, id);
+            append32(frames_, code);
+            metrics::record_event(metrics::http2_stream_reset);
+            stream_map::iterator it = streams_.find(id);
+            if (it != streams_.end())
+                retire(it->second);
+        }
+
+        void http2_session::retire(stream &s) {
+            s.closed = true;
+            if (flushing_)
+                retired_.push_back(s.id);
+            else
+                erase(s.id);
+        }
+
+        void http2_session::complete(stream &s) {
+            if (resets_allowed_ < max_concurrent_streams)
+                ++resets_allowed_;
+            std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - s.start;
+            metrics::record_request(s.rep.status, s.body_bytes);
+            metrics::record_latency(metrics::response_time, elapsed);
+            if (logging::access_enabled.load(std::memory_order_relaxed)) {
+                boost::string_view range;
+                for (const request_header &h : s.req.headers) {
+                    if (h.name == "range")
+                        range = h.value;
+                }
+                logging::access(s.req.uri, range, s.rep.status, s.body_bytes, elapsed);
+            }
+            erase(s.id);
+        }
+
+        void http2_session::erase(boost::uint32_t id) {
+            stream_map::iterator it = streams_.find(id);
+            if (it == streams_.end())
+                return;
+            if (admission_)
+                admission_->release(it->second.reserved);
+            for (stream_map::value_type &entry : streams_) {
+                if (entry.second.parent == id)
+                    entry.second.parent = it->second.parent;
+            }
+            ending_.erase(std::remove(ending_.begin(), ending_.end(), id), ending_.end());
+            streams_.erase(it);
+        }
+
+        bool http2_session::fail(boost::uint32_t code) {
+            if (!goaway_sent_) {
+                HTTP_SERVER3_LOG(debug, "Closing an HTTP/2 connection with error " << code);
+                write_frame(frames_, 8, frame_goaway, 0, 0);
+                append32(frames_, last_stream_id_);
+                append32(frames_, code);
+                goaway_sent_ = true;
+            }
+            return false;
+        }
+
+        void http2_session::write_window_update(boost::uint32_t id, boost::uint32_t increment) {
+            write_frame(frames_, 4, frame_window_update, 0, id);
+            append32(frames_, increment);
+        }
+
+    }
+}
@@ -0,0 +1,215 @@
+#ifndef HTTP_SERVER3_HTTP2_SESSION_HPP
+#define HTTP_SERVER3_HTTP2_SESSION_HPP
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/utility/string_view.hpp>
+#include "admission_control.hpp"
+#include "file_cache.hpp"
+#include "hpack.hpp"
+#include "reply.hpp"
+#include "request.hpp"
+#include "request_handler.hpp"
+
+namespace http {
+    namespace server3 {
+
+        class http2_session : private boost::noncopyable {
+        public:
+            static const boost::string_view preface;
+
+            struct output {
+                output() : offset(0), length(0) {}
+
+                std::vector<boost::asio::const_buffer> buffers;
+
+                cached_file_ptr file;
+
+                unsigned long long offset;
+
+                std::size_t length;
+            };
+
+            http2_session(request_handler &handler, admission_control *admission, bool first_request);
+
+            ~http2_session();
+
+            bool upgrade(const request &req, boost::string_view settings);
+
+            void consume(const char *data, std::size_t size);
+
+            bool data_pending();
+
+            bool next_output(output &out, std::size_t budget);
+
+            void written();
+
+            bool active() const {
+                return !streams_.empty();
+            }
+
+            bool congested() const;
+
+            bool finished() const;
+
+        private:
+            struct piece {
+                boost::asio::const_buffer memory;
+
+                unsigned long long offset;
+
+                unsigned long long length;
+
+                bool file;
+            };
+
+            struct stream {
+                stream();
+
+                boost::uint32_t id;
+
+                boost::uint32_t parent;
+
+                unsigned int weight;
+
+                boost::int64_t window;
+
+                unsigned long long pass;
+
+                std::vector<header> fields;
+
+                request req;
+
+                reply rep;
+
+                std::vector<piece> body;
+
+                std::size_t next_piece;
+
+                unsigned long long piece_sent;
+
+                unsigned long long body_bytes;
+
+                unsigned long long reserved;
+
+                std::chrono::steady_clock::time_point start;
+
+                bool closed;
+            };
+
+            typedef std::map<boost::uint32_t, stream> stream_map;
+
+            bool parse_frame(const unsigned char *header, const unsigned char *payload);
+
+            bool handle_headers(boost::uint32_t id, unsigned char flags, const unsigned char *payload,
+                                std::size_t length);
+
+            bool handle_priority(boost::uint32_t id, const unsigned char *payload, std::size_t length);
+
+            bool handle_settings(unsigned char flags, const unsigned char *payload, std::size_t length);
+
+            bool handle_window_update(boost::uint32_t id, const unsigned char *payload, std::size_t length);
+
+            boost::uint32_t apply_settings(const unsigned char *payload, std::size_t length);
+
+            bool open_stream();
+
+            void dispatch(stream &s);
+
+            void respond(stream &s);
+
+            static void add_body(stream &s, const std::vector<boost::asio::const_buffer> &memory,
+                                 unsigned long long offset, unsigned long long length);
+
+            void prioritize(stream &s, boost::uint32_t dependency, unsigned int weight, bool exclusive);
+
+            bool descends(boost::uint32_t id, boost::uint32_t ancestor) const;
+
+            stream *schedule();
+
+            bool sendable(const stream &s) const;
+
+            void reset_stream(boost::uint32_t id, boost::uint32_t code);
+
+            void retire(stream &s);
+
+            void complete(stream &s);
+
+            void erase(boost::uint32_t id);
+
+            bool fail(boost::uint32_t code);
+
+            void write_window_update(boost::uint32_t id, boost::uint32_t increment);
+
+            request_handler &request_handler_;
+
+            admission_control *admission_;
+
+            bool first_request_;
+
+            hpack::decoder decoder_;
+
+            hpack::encoder encoder_;
+
+            stream_map streams_;
+
+            std::string input_;
+
+            bool preface_received_;
+
+            bool settings_received_;
+
+            std::string frames_;
+
+            std::string sending_;
+
+            std::string data_headers_;
+
+            std::vector<boost::uint32_t> ending_;
+
+            std::vector<boost::uint32_t> sending_ending_;
+
+            std::vector<boost::uint32_t> retired_;
+
+            bool flushing_;
+
+            std::string header_block_;
+
+            boost::uint32_t continuing_;
+
+            unsigned char continuing_flags_;
+
+            boost::uint32_t priority_dependency_;
+
+            unsigned int priority_weight_;
+
+            bool priority_exclusive_;
+
+            boost::uint32_t last_stream_id_;
+
+            boost::int64_t window_;
+
+            boost::int64_t initial_window_;
+
+            std::size_t max_frame_size_;
+
+            unsigned long long pass_;
+
+            std::size_t pending_acks_;
+
+            std::size_t resets_allowed_;
+
+            bool goaway_sent_;
+
+            bool goaway_received_;
+        };
+
+    }
+}
+
+#endif
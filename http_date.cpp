@@ -0,0 +1,212 @@
+#include "http_date.hpp"
+#include <ctime>
+#include <boost/make_shared.hpp>
+
+namespace http {
+    namespace server3 {
+        namespace http_date {
+
+            namespace {
+
+                const char day_names[] = "SunMonTueWedThuFriSat";
+
+                const char month_names[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+                const char *const long_day_names[] = {
+                        "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"
+                };
+
+                long long days_from_civil(long long year, unsigned int month, unsigned int day) {
+                    year -= month <= 2;
+                    long long era = (year >= 0 ? year : year - 399) / 400;
+                    unsigned int year_of_era = static_cast<unsigned int>(year - era * 400);
+                    unsigned int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+                    unsigned int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+                    return era * 146097 + static_cast<long long>(day_of_era) - 719468;
+                }
+
+                void civil_from_days(long long days, long long &year, unsigned int &month, unsigned int &day) {
+                    days += 719468;
+                    long long era = (days >= 0 ? days : days - 146096) / 146097;
+                    unsigned int day_of_era = static_cast<unsigned int>(days - era * 146097);
+                    unsigned int year_of_era =
+                            (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+                    unsigned int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+                    unsigned int mp = (5 * day_of_year + 2) / 153;
+                    day = day_of_year - (153 * mp + 2) / 5 + 1;
+                    month = mp < 10 ? mp + 3 : mp - 9;
+                    year = static_cast<long long>(year_of_era) + era * 400 + (month <= 2);
+                }
+
+                class cursor {
+                public:
+                    explicit cursor(boost::string_view value) : position_(value.begin()), end_(value.end()) {}
+
+                    bool done() const {
+                        return position_ == end_;
+                    }
+
+                    bool literal(char c) {
+                        if (position_ == end_ || *position_ != c)
+                            return false;
+                        ++position_;
+                        return true;
+                    }
+
+                    bool spaces() {
+                        const char *begin = position_;
+                        while (position_ != end_ && *position_ == ' ')
+                            ++position_;
+                        return position_ != begin;
+                    }
+
+                    bool number(std::size_t min_digits, std::size_t max_digits, unsigned int &value) {
+                        value = 0;
+                        std::size_t digits = 0;
+                        while (position_ != end_ && digits < max_digits && *position_ >= '0' && *position_ <= '9') {
+                            value = value * 10 + static_cast<unsigned int>(*position_++ - '0');
+                            ++digits;
+                        }
+                        return digits >= min_digits;
+                    }
+
+                    bool name(const char *names, std::size_t count, unsigned int &index) {
+                        if (end_ - position_ < 3)
+                            return false;
+                        for (index = 0; index < count; ++index) {
+                            if (position_[0] == names[index * 3] && position_[1] == names[index * 3 + 1]
+                                && position_[2] == names[index * 3 + 2]) {
+                                position_ += 3;
+                                return true;
+                            }
+                        }
+                        return false;
+                    }
+
+                    bool word(boost::string_view expected) {
+                        if (static_cast<std::size_t>(end_ - position_) < expected.size()
+                            || boost::string_view(position_, expected.size()) != expected)
+                            return false;
+                        position_ += expected.size();
+                        return true;
+                    }
+
+                    bool time(unsigned int &hour, unsigned int &minute, unsigned int &second) {
+                        return number(2, 2, hour) && literal(':') && number(2, 2, minute) && literal(':')
+                               && number(2, 2, second);
+                    }
+
+                private:
+                    const char *position_;
+                    const char *end_;
+                };
+
+                bool to_seconds(long long year, unsigned int month, unsigned int day, unsigned int hour,
+                                unsigned int minute, unsigned int second, long long &seconds) {
+                    static const unsigned int month_days[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+                    if (month < 1 || month > 12 || day < 1 || day > month_days[month - 1] || hour > 23
+                        || minute > 59 || second > 60)
+                        return false;
+                    seconds = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+                    return true;
+                }
+
+                void write_number(char *out, unsigned int value, std::size_t digits) {
+                    while (digits-- > 0) {
+                        out[digits] = static_cast<char>('0' + value % 10);
+                        value /= 10;
+                    }
+                }
+            }
+
+            bool parse(boost::string_view value, long long &seconds) {
+                cursor in(value);
+                unsigned int weekday, day, month, year, hour, minute, second;
+
+                if (in.name(day_names, 7, weekday)) {
+                    if (in.literal(',')) {
+                        if (in.spaces() && in.number(2, 2, day) && in.spaces() && in.name(month_names, 12, month)
+                            && in.spaces() && in.number(4, 4, year) && in.spaces() && in.time(hour, minute, second)
+                            && in.spaces() && in.word("GMT") && in.done())
+                            return to_seconds(year, month + 1, day, hour, minute, second, seconds);
+                        return false;
+                    }
+                    if (in.spaces()) {
+                        if (in.name(month_names, 12, month) && in.spaces() && in.number(1, 2, day) && in.spaces()
+                            && in.time(hour, minute, second) && in.spaces() && in.number(4, 4, year) && in.done())
+                            return to_seconds(year, month + 1, day, hour, minute, second, seconds);
+                        return false;
+                    }
+                    if (in.word(long_day_names[weekday] + 3) && in.literal(',') && in.spaces()
+                        && in.number(2, 2, day) && in.literal('-') && in.name(month_names, 12, month)
+                        && in.literal('-') && in.number(2, 2, year) && in.spaces() && in.time(hour, minute, second)
+                        && in.spaces() && in.word("GMT") && in.done()) {
+                        std::time_t current = std::time(0);
+                        std::tm utc;
+                        gmtime_r(&current, &utc);
+                        long long full_year = 1900 + utc.tm_year - (1900 + utc.tm_year) % 100 + year;
+                        if (full_year > 1900 + utc.tm_year + 50)
+                            full_year -= 100;
+                        return to_seconds(full_year, month + 1, day, hour, minute, second, seconds);
+                    }
+                }
+                return false;
+            }
+
+            void format(long long seconds, char *out) {
+                long long days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+                unsigned int time_of_day = static_cast<unsigned int>(seconds - days * 86400);
+                long long year;
+                unsigned int month, day;
+                civil_from_days(days, year, month, day);
+                unsigned int weekday = static_cast<unsigned int>((days % 7 + 11) % 7);
+
+                out[0] = day_names[weekday * 3];
+                out[1] = day_names[weekday * 3 + 1];
+                out[2] = day_names[weekday * 3 + 2];
+                out[3] = ',';
+                out[4] = ' ';
+                write_number(out + 5, day, 2);
+                out[7] = ' ';
+                out[8] = month_names[(month - 1) * 3];
+                out[9] = month_names[(month - 1) * 3 + 1];
+                out[10] = month_names[(month - 1) * 3 + 2];
+                out[11] = ' ';
+                write_number(out + 12, static_cast<unsigned int>(year), 4);
+                out[16] = ' ';
+                write_number(out + 17, time_of_day / 3600, 2);
+                out[19] = ':';
+                write_number(out + 20, time_of_day / 60 % 60, 2);
+                out[22] = ':';
+                write_number(out + 23, time_of_day % 60, 2);
+                out[25] = ' ';
+                out[26] = 'G';
+                out[27] = 'M';
+                out[28] = 'T';
+            }
+
+            std::string format(long long seconds) {
+                std::string out(length, ' ');
+                format(seconds, &out[0]);
+                return out;
+            }
+
+            boost::shared_ptr<const snapshot> now() {
+                static boost::shared_ptr<const snapshot> current;
+
+                long long second = static_cast<long long>(std::time(0));
+                boost::shared_ptr<const snapshot> cached = boost::atomic_load(&current);
+                if (cached && cached->second == second)
+                    return cached;
+
+                boost::shared_ptr<snapshot> fresh = boost::make_shared<snapshot>();
+                fresh->second = second;
+                fresh->date = format(second);
+                fresh->expires = format(second + expires_after);
+                boost::atomic_store(&current, boost::shared_ptr<const snapshot>(fresh));
+                return fresh;
+            }
+
+        }
+    }
+}
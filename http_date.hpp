@@ -0,0 +1,35 @@
+#ifndef HTTP_SERVER3_HTTP_DATE_HPP
+#define HTTP_SERVER3_HTTP_DATE_HPP
+
+#include <cstddef>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility/string_view.hpp>
+
+namespace http {
+    namespace server3 {
+        namespace http_date {
+
+            const std::size_t length = 29;
+
+            const long long expires_after = 7 * 24 * 60 * 60;
+
+            struct snapshot {
+                long long second;
+                std::string date;
+                std::string expires;
+            };
+
+            bool parse(boost::string_view value, long long &seconds);
+
+            void format(long long seconds, char *out);
+
+            std::string format(long long seconds);
+
+            boost::shared_ptr<const snapshot> now();
+
+        }
+    }
+}
+
+#endif
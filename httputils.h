@@ -1,38 +1,86 @@
 #ifndef CPP_HTTP_RANGE_FILESERVER_HTTPUTILS_H
 #define CPP_HTTP_RANGE_FILESERVER_HTTPUTILS_H
 
+#include <algorithm>
 #include <string>
-#include <regex>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/utility/string_view.hpp>
 
 namespace httputils {
-    static std::string replaceAll(const std::string &s, const std::string &rgx_str, const std::string &target) {
-        std::regex e(rgx_str);
-        return std::regex_replace(s, e, target);
+    static boost::string_view trim(boost::string_view value) {
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+            value.remove_prefix(1);
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+            value.remove_suffix(1);
+        return value;
     }
 
-    static void split(const std::string &s, std::vector<std::string> &target, const std::string rgx_str = "\\s+") {
-        std::regex rgx(rgx_str);
-        std::sregex_token_iterator iter(s.begin(), s.end(), rgx, -1);
-        std::sregex_token_iterator end;
-        while (iter != end) {
-            target.push_back(*iter++);
+    static bool accepts(boost::string_view acceptHeader, boost::string_view toAccept) {
+        boost::string_view::size_type slash = toAccept.find('/');
+        while (true) {
+            boost::string_view::size_type next = acceptHeader.find_first_of(",;");
+            boost::string_view value = trim(acceptHeader.substr(0, next));
+            if (value == toAccept || value == "*/*"
+                || (slash != boost::string_view::npos && value.size() == slash + 2 && value.back() == '*'
+                    && value.starts_with(toAccept.substr(0, slash + 1))))
+                return true;
+            if (next == boost::string_view::npos)
+                return false;
+            acceptHeader.remove_prefix(next + 1);
         }
     }
 
-    static bool accepts(std::string &acceptHeader, std::string &toAccept) {
-        std::vector<std::string> acceptValues;
-        split(acceptHeader, acceptValues, "\\s*(,|;)\\s*");
-        return (std::find(acceptValues.begin(), acceptValues.end(), toAccept) != acceptValues.end()) ||
-               (std::find(acceptValues.begin(), acceptValues.end(), replaceAll(toAccept, "/.*$", "/*")) !=
-                acceptValues.end()) ||
-               (std::find(acceptValues.begin(), acceptValues.end(), "*/*") != acceptValues.end());
+    static int quality(boost::string_view parameters) {
+        while (!parameters.empty()) {
+            boost::string_view::size_type next = parameters.find(';');
+            boost::string_view parameter = trim(parameters.substr(0, next));
+            if (parameter.size() >= 3 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=') {
+                int value = parameter[2] == '1' ? 1000 : 0;
+                int scale = 100;
+                for (std::size_t i = 4; i < parameter.size() && i < 7 && parameter[3] == '.'; ++i, scale /= 10) {
+                    if (parameter[i] < '0' || parameter[i] > '9')
+                        break;
+                    value += (parameter[i] - '0') * scale;
+                }
+                return std::min(value, 1000);
+            }
+            if (next == boost::string_view::npos)
+                break;
+            parameters.remove_prefix(next + 1);
+        }
+        return 1000;
     }
 
-    static bool matches(std::string &matchHeader, std::string &toMatch) {
-        std::vector<std::string> matchValues;
-        split(matchHeader, matchValues, "\\s*,\\s*");
-        return (std::find(matchValues.begin(), matchValues.end(), toMatch) != matchValues.end())
-               || (std::find(matchValues.begin(), matchValues.end(), "*") != matchValues.end());
+    static int encodingQuality(boost::string_view acceptEncoding, boost::string_view coding) {
+        int wildcard = -1;
+        while (true) {
+            boost::string_view::size_type next = acceptEncoding.find(',');
+            boost::string_view element = trim(acceptEncoding.substr(0, next));
+            boost::string_view::size_type semicolon = element.find(';');
+            boost::string_view name = trim(element.substr(0, semicolon));
+            int q = semicolon == boost::string_view::npos ? 1000 : quality(element.substr(semicolon + 1));
+            if (boost::algorithm::iequals(name, coding))
+                return q;
+            if (name == "*")
+                wildcard = q;
+            if (next == boost::string_view::npos)
+                return wildcard;
+            acceptEncoding.remove_prefix(next + 1);
+        }
+    }
+
+    static bool matches(boost::string_view matchHeader, boost::string_view toMatch, bool weak = false) {
+        while (true) {
+            boost::string_view::size_type next = matchHeader.find(',');
+            boost::string_view value = trim(matchHeader.substr(0, next));
+            if (weak && value.starts_with("W/"))
+                value.remove_prefix(2);
+            if (value == toMatch || value == "*")
+                return true;
+            if (next == boost::string_view::npos)
+                return false;
+            matchHeader.remove_prefix(next + 1);
+        }
     }
 }
 
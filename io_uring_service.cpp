@@ -0,0 +1,308 @@
+#include "io_uring_service.hpp"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace http {
+    namespace server3 {
+
+        namespace {
+            int io_uring_setup(unsigned int entries, io_uring_params *params) {
+                return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+            }
+
+            int io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+                return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, 0, 0));
+            }
+
+            int io_uring_register(int fd, unsigned int opcode, const void *arg, unsigned int nr_args) {
+                return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+            }
+
+            void throw_errno(const char *what) {
+                throw boost::system::system_error(
+                        boost::system::error_code(errno, boost::system::system_category()), what);
+            }
+
+            const unsigned long long cancel_user_data = ~0ULL;
+
+            template<typename T>
+            T *ring_field(void *ring, unsigned int offset) {
+                return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+            }
+        }
+
+        io_uring_service::io_uring_service(boost::asio::io_context &io_context, unsigned int entries)
+                : io_context_(io_context),
+                  ring_fd_(-1),
+                  sq_ring_(MAP_FAILED),
+                  sq_ring_size_(0),
+                  cq_ring_(MAP_FAILED),
+                  cq_ring_size_(0),
+                  sqes_(static_cast<io_uring_sqe *>(MAP_FAILED)),
+                  sqes_size_(0),
+                  to_submit_(0),
+                  flush_scheduled_(false),
+                  next_id_(0),
+                  event_descriptor_(io_context),
+                  event_value_(0) {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            ring_fd_ = io_uring_setup(entries, &params);
+            if (ring_fd_ < 0)
+                throw_errno("io_uring_setup");
+
+            sq_entries_ = params.sq_entries;
+            sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+            cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+                sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+            sq_ring_ = ::mmap(0, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              ring_fd_, IORING_OFF_SQ_RING);
+            if (sq_ring_ == MAP_FAILED) {
+                int error = errno;
+                close();
+                errno = error;
+                throw_errno("mmap");
+            }
+            if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                cq_ring_ = sq_ring_;
+            } else {
+                cq_ring_ = ::mmap(0, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  ring_fd_, IORING_OFF_CQ_RING);
+            }
+            sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = static_cast<io_uring_sqe *>(::mmap(0, sqes_size_, PROT_READ | PROT_WRITE,
+                                                       MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+            if (cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+                int error = errno;
+                close();
+                errno = error;
+                throw_errno("mmap");
+            }
+
+            sq_head_ = ring_field<unsigned int>(sq_ring_, params.sq_off.head);
+            sq_tail_ = ring_field<unsigned int>(sq_ring_, params.sq_off.tail);
+            sq_mask_ = ring_field<unsigned int>(sq_ring_, params.sq_off.ring_mask);
+            sq_array_ = ring_field<unsigned int>(sq_ring_, params.sq_off.array);
+            cq_head_ = ring_field<unsigned int>(cq_ring_, params.cq_off.head);
+            cq_tail_ = ring_field<unsigned int>(cq_ring_, params.cq_off.tail);
+            cq_mask_ = ring_field<unsigned int>(cq_ring_, params.cq_off.ring_mask);
+            cqes_ = ring_field<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+            in_flight_.resize(params.cq_entries);
+            for (unsigned int i = 0; i < params.cq_entries; ++i)
+                free_slots_.push_back(params.cq_entries - 1 - i);
+
+            int event_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (event_fd < 0 || io_uring_register(ring_fd_, IORING_REGISTER_EVENTFD, &event_fd, 1) < 0) {
+                int error = errno;
+                if (event_fd >= 0)
+                    ::close(event_fd);
+                close();
+                errno = error;
+                throw_errno("io_uring_register");
+            }
+            event_descriptor_.assign(event_fd);
+            wait_for_completions();
+        }
+
+        io_uring_service::~io_uring_service() {
+            close();
+        }
+
+        void io_uring_service::close() {
+            boost::system::error_code ignored_ec;
+            event_descriptor_.close(ignored_ec);
+            if (sqes_ != MAP_FAILED)
+                ::munmap(sqes_, sqes_size_);
+            if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+                ::munmap(cq_ring_, cq_ring_size_);
+            if (sq_ring_ != MAP_FAILED)
+                ::munmap(sq_ring_, sq_ring_size_);
+            if (ring_fd_ >= 0)
+                ::close(ring_fd_);
+            sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+            cq_ring_ = sq_ring_ = MAP_FAILED;
+            ring_fd_ = -1;
+        }
+
+        io_uring_service::ticket io_uring_service::submit(operation op) {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            op.id = ++next_id_;
+            if (!backlog_.empty() || !push(op))
+                backlog_.push_back(op);
+            schedule_flush();
+            return op.id;
+        }
+
+        void io_uring_service::cancel(ticket id) {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            for (std::deque<operation>::iterator it = backlog_.begin(); it != backlog_.end(); ++it) {
+                if (it->id == id) {
+                    it->handler(boost::asio::error::operation_aborted, 0);
+                    backlog_.erase(it);
+                    return;
+                }
+            }
+
+            if (slots_.find(id) == slots_.end())
+                return;
+            operation op = {IORING_OP_ASYNC_CANCEL, -1, 0, 0, id, completion(), 0};
+            if (!push(op))
+                backlog_.push_front(op);
+            schedule_flush();
+        }
+
+        bool io_uring_service::push(const operation &op) {
+            bool cancel = op.opcode == IORING_OP_ASYNC_CANCEL;
+            if (!cancel && free_slots_.empty())
+                return false;
+
+            unsigned int tail = *sq_tail_;
+            unsigned int head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+            if (tail - head >= sq_entries_)
+                return false;
+
+            unsigned int index = tail & *sq_mask_;
+            io_uring_sqe &sqe = sqes_[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = static_cast<boost::uint8_t>(op.opcode);
+            sqe.fd = op.fd;
+            if (cancel) {
+                sqe.addr = op.offset;
+                sqe.user_data = cancel_user_data;
+            } else {
+                unsigned int slot = free_slots_.back();
+                free_slots_.pop_back();
+                in_flight_[slot] = op.handler;
+                slots_[op.id] = slot;
+                sqe.addr = reinterpret_cast<unsigned long long>(op.data);
+                sqe.len = static_cast<unsigned int>(op.size);
+                sqe.off = op.offset;
+                if (op.opcode == IORING_OP_SEND)
+                    sqe.msg_flags = MSG_NOSIGNAL;
+                sqe.user_data = op.id;
+            }
+            sq_array_[index] = index;
+            __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+            ++to_submit_;
+            return true;
+        }
+
+        void io_uring_service::schedule_flush() {
+            if (!flush_scheduled_ && to_submit_ > 0) {
+                flush_scheduled_ = true;
+                boost::asio::post(io_context_, boost::bind(&io_uring_service::flush, this));
+            }
+        }
+
+        void io_uring_service::flush() {
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                flush_scheduled_ = false;
+                if (to_submit_ == 0)
+                    return;
+
+                int submitted = io_uring_enter(ring_fd_, to_submit_, 0, 0);
+                if (submitted >= 0) {
+                    to_submit_ -= std::min<unsigned int>(submitted, to_submit_);
+                    schedule_flush();
+                    return;
+                }
+                if (errno == EINTR || errno == EAGAIN) {
+                    schedule_flush();
+                    return;
+                }
+                if (errno != EBUSY) {
+                    fail_queued(boost::system::error_code(errno, boost::system::system_category()));
+                    return;
+                }
+            }
+            drain_completions();
+        }
+
+        void io_uring_service::fail_queued(const boost::system::error_code &e) {
+            unsigned int tail = *sq_tail_;
+            for (unsigned int i = tail - to_submit_; i != tail; ++i) {
+                const io_uring_sqe &sqe = sqes_[sq_array_[i & *sq_mask_]];
+                boost::unordered_map<ticket, unsigned int>::iterator it = slots_.find(sqe.user_data);
+                if (it == slots_.end())
+                    continue;
+                unsigned int slot = it->second;
+                slots_.erase(it);
+                in_flight_[slot](e, 0);
+                in_flight_[slot] = completion();
+                free_slots_.push_back(slot);
+            }
+            __atomic_store_n(sq_tail_, tail - to_submit_, __ATOMIC_RELEASE);
+            to_submit_ = 0;
+
+            for (std::deque<operation>::iterator it = backlog_.begin(); it != backlog_.end(); ++it) {
+                if (it->handler)
+                    it->handler(e, 0);
+            }
+            backlog_.clear();
+        }
+
+        void io_uring_service::wait_for_completions() {
+            event_descriptor_.async_read_some(boost::asio::buffer(&event_value_, sizeof(event_value_)),
+                                              boost::bind(&io_uring_service::handle_completions, this,
+                                                          boost::asio::placeholders::error));
+        }
+
+        void io_uring_service::handle_completions(const boost::system::error_code &e) {
+            if (e == boost::asio::error::operation_aborted)
+                return;
+
+            drain_completions();
+            wait_for_completions();
+        }
+
+        void io_uring_service::drain_completions() {
+            std::vector<std::pair<completion, int> > ready;
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                unsigned int head = *cq_head_;
+                unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+                for (; head != tail; ++head) {
+                    const io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+                    boost::unordered_map<ticket, unsigned int>::iterator it = slots_.find(cqe.user_data);
+                    if (it == slots_.end())
+                        continue;
+                    unsigned int slot = it->second;
+                    slots_.erase(it);
+                    ready.push_back(std::make_pair(in_flight_[slot], cqe.res));
+                    in_flight_[slot] = completion();
+                    free_slots_.push_back(slot);
+                }
+                __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+                while (!backlog_.empty() && push(backlog_.front()))
+                    backlog_.pop_front();
+                schedule_flush();
+            }
+
+            for (std::size_t i = 0; i < ready.size(); ++i) {
+                if (ready[i].second < 0)
+                    ready[i].first(boost::system::error_code(-ready[i].second, boost::system::system_category()), 0);
+                else
+                    ready[i].first(boost::system::error_code(), static_cast<std::size_t>(ready[i].second));
+            }
+        }
+
+    }
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef HTTP_SERVER3_IO_URING_SERVICE_HPP
+#define HTTP_SERVER3_IO_URING_SERVICE_HPP
+
+#if defined(__linux__)
+
+#include <deque>
+#include <functional>
+#include <vector>
+#include <linux/io_uring.h>
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace http {
+    namespace server3 {
+
+        class io_uring_service : private boost::noncopyable {
+        public:
+            typedef std::function<void(const boost::system::error_code &, std::size_t)> completion;
+
+            typedef unsigned long long ticket;
+
+            explicit io_uring_service(boost::asio::io_context &io_context, unsigned int entries = 256);
+
+            ~io_uring_service();
+
+            template<typename Handler>
+            ticket async_read(int fd, void *data, std::size_t size, unsigned long long offset, Handler handler) {
+                operation op = {IORING_OP_READ, fd, data, size, offset, wrap(handler), 0};
+                return submit(op);
+            }
+
+            template<typename Handler>
+            ticket async_send(int fd, const void *data, std::size_t size, Handler handler) {
+                operation op = {IORING_OP_SEND, fd, const_cast<void *>(data), size, 0, wrap(handler), 0};
+                return submit(op);
+            }
+
+            void cancel(ticket id);
+
+        private:
+            struct operation {
+                int opcode;
+                int fd;
+                void *data;
+                std::size_t size;
+                unsigned long long offset;
+                completion handler;
+                ticket id;
+            };
+
+            template<typename Handler>
+            completion wrap(Handler handler) {
+                typename boost::asio::associated_executor<Handler, boost::asio::io_context::executor_type>::type ex =
+                        boost::asio::get_associated_executor(handler, io_context_.get_executor());
+                return [ex, handler](const boost::system::error_code &e, std::size_t bytes_transferred) {
+                    Handler h(handler);
+                    boost::asio::post(ex, [h, e, bytes_transferred]() mutable { h(e, bytes_transferred); });
+                };
+            }
+
+            void close();
+
+            ticket submit(operation op);
+
+            bool push(const operation &op);
+
+            void schedule_flush();
+
+            void flush();
+
+            void fail_queued(const boost::system::error_code &e);
+
+            void wait_for_completions();
+
+            void handle_completions(const boost::system::error_code &e);
+
+            void drain_completions();
+
+            boost::asio::io_context &io_context_;
+
+            boost::mutex mutex_;
+
+            int ring_fd_;
+
+            void *sq_ring_;
+
+            std::size_t sq_ring_size_;
+
+            void *cq_ring_;
+
+            std::size_t cq_ring_size_;
+
+            io_uring_sqe *sqes_;
+
+            std::size_t sqes_size_;
+
+            unsigned int sq_entries_;
+
+            unsigned int *sq_head_;
+
+            unsigned int *sq_tail_;
+
+            unsigned int *sq_mask_;
+
+            unsigned int *sq_array_;
+
+            unsigned int *cq_head_;
+
+            unsigned int *cq_tail_;
+
+            unsigned int *cq_mask_;
+
+            io_uring_cqe *cqes_;
+
+            unsigned int to_submit_;
+
+            bool flush_scheduled_;
+
+            std::vector<completion> in_flight_;
+
+            boost::unordered_map<ticket, unsigned int> slots_;
+
+            ticket next_id_;
+
+            std::vector<unsigned int> free_slots_;
+
+            std::deque<operation> backlog_;
+
+            boost::asio::posix::stream_descriptor event_descriptor_;
+
+            boost::uint64_t event_value_;
+        };
+
+    }
+}
+
+#endif
+
+#endif
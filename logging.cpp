@@ -0,0 +1,288 @@
+#include "logging.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace http {
+    namespace server3 {
+        namespace logging {
+
+            std::atomic<int> threshold(off);
+
+            std::atomic<bool> access_enabled(false);
+
+            namespace {
+
+                enum record_kind {
+                    text_record, access_record_kind
+                };
+
+                struct slot {
+                    boost::int64_t time_us;
+                    boost::uint16_t size;
+                    boost::uint8_t kind;
+                    boost::uint8_t severity;
+                    char data[500];
+                };
+
+                class ring : private boost::noncopyable {
+                public:
+                    ring() : head_(0), tail_(0) {}
+
+                    slot *prepare() {
+                        std::size_t tail = tail_.load(std::memory_order_relaxed);
+                        if (tail - head_.load(std::memory_order_acquire) == capacity)
+                            return 0;
+                        return &slots_[tail % capacity];
+                    }
+
+                    void commit() {
+                        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                    }
+
+                    const slot *front() {
+                        std::size_t head = head_.load(std::memory_order_relaxed);
+                        if (head == tail_.load(std::memory_order_acquire))
+                            return 0;
+                        return &slots_[head % capacity];
+                    }
+
+                    void pop() {
+                        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                    }
+
+                private:
+                    static const std::size_t capacity = 512;
+
+                    slot slots_[capacity];
+
+                    std::atomic<std::size_t> head_;
+
+                    std::atomic<std::size_t> tail_;
+                };
+
+                const char *const level_names[] = {"debug", "info", "warning", "error", "off"};
+
+                class writer : private boost::noncopyable {
+                public:
+                    writer() : access_file_(0), running_(false), dropped_(0) {}
+
+                    ring &local_ring() {
+                        thread_local ring *local = 0;
+                        if (!local) {
+                            boost::shared_ptr<ring> created = boost::make_shared<ring>();
+                            boost::lock_guard<boost::mutex> lock(mutex_);
+                            rings_.push_back(created);
+                            local = created.get();
+                        }
+                        return *local;
+                    }
+
+                    void drop() {
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                    }
+
+                    void start(const std::string &access_log_path) {
+                        if (!access_log_path.empty()) {
+                            access_file_ = std::fopen(access_log_path.c_str(), "ab");
+                            if (!access_file_)
+                                throw std::runtime_error("cannot open access log " + access_log_path);
+                            std::fseek(access_file_, 0, SEEK_END);
+                            if (std::ftell(access_file_) == 0)
+                                std::fwrite(access_log_magic, 1, sizeof(access_log_magic), access_file_);
+                        }
+                        running_ = true;
+                        thread_.reset(new boost::thread(&writer::run, this));
+                    }
+
+                    void stop() {
+                        if (thread_) {
+                            running_ = false;
+                            thread_->join();
+                            thread_.reset();
+                        }
+                        drain();
+                        if (access_file_) {
+                            std::fclose(access_file_);
+                            access_file_ = 0;
+                        }
+                    }
+
+                private:
+                    void run() {
+                        while (running_) {
+                            if (!drain())
+                                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                        }
+                    }
+
+                    bool drain() {
+                        std::vector<ring *> rings;
+                        {
+                            boost::lock_guard<boost::mutex> lock(mutex_);
+                            for (std::size_t i = 0; i < rings_.size(); ++i)
+                                rings.push_back(rings_[i].get());
+                        }
+
+                        bool drained = false;
+                        for (std::size_t i = 0; i < rings.size(); ++i) {
+                            while (const slot *s = rings[i]->front()) {
+                                write(*s);
+                                rings[i]->pop();
+                                drained = true;
+                            }
+                        }
+
+                        unsigned long long dropped = dropped_.exchange(0, std::memory_order_relaxed);
+                        if (dropped > 0)
+                            std::fprintf(stderr, "%llu log records dropped\n", dropped);
+                        if (drained) {
+                            std::fflush(stderr);
+                            if (access_file_)
+                                std::fflush(access_file_);
+                        }
+                        return drained;
+                    }
+
+                    void write(const slot &s) {
+                        if (s.kind == access_record_kind) {
+                            if (access_file_)
+                                std::fwrite(s.data, 1, s.size, access_file_);
+                            return;
+                        }
+
+                        std::time_t seconds = static_cast<std::time_t>(s.time_us / 1000000);
+                        std::tm utc;
+                        gmtime_r(&seconds, &utc);
+                        char stamp[32];
+                        std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+                        std::fprintf(stderr, "%s.%06dZ %s %.*s\n", stamp, static_cast<int>(s.time_us % 1000000),
+                                     level_names[s.severity], static_cast<int>(s.size), s.data);
+                    }
+
+                    boost::mutex mutex_;
+
+                    std::vector<boost::shared_ptr<ring> > rings_;
+
+                    std::FILE *access_file_;
+
+                    std::atomic<bool> running_;
+
+                    std::atomic<unsigned long long> dropped_;
+
+                    boost::scoped_ptr<boost::thread> thread_;
+                };
+
+                writer &instance() {
+                    static writer w;
+                    return w;
+                }
+
+                boost::int64_t now_us() {
+                    return std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count();
+                }
+            }
+
+            bool parse_level(boost::string_view name, level &severity) {
+                for (int i = debug; i <= off; ++i) {
+                    if (name == level_names[i]) {
+                        severity = static_cast<level>(i);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void start(level severity, const std::string &access_log_path) {
+                instance().start(access_log_path);
+                threshold.store(severity, std::memory_order_relaxed);
+                access_enabled.store(!access_log_path.empty(), std::memory_order_relaxed);
+            }
+
+            void stop() {
+                threshold.store(off, std::memory_order_relaxed);
+                access_enabled.store(false, std::memory_order_relaxed);
+                instance().stop();
+            }
+
+            void access(boost::string_view path, boost::string_view ranges, unsigned int status,
+                        unsigned long long bytes, std::chrono::steady_clock::duration latency) {
+                if (!access_enabled.load(std::memory_order_relaxed))
+                    return;
+
+                ring &r = instance().local_ring();
+                slot *s = r.prepare();
+                if (!s) {
+                    instance().drop();
+                    return;
+                }
+
+                access_record record;
+                record.time_us = now_us();
+                record.bytes = bytes;
+                record.latency_us = static_cast<boost::uint32_t>(
+                        std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+                record.status = static_cast<boost::uint16_t>(status);
+                record.path_length = static_cast<boost::uint8_t>(std::min<std::size_t>(path.size(), 255));
+                record.range_length = static_cast<boost::uint8_t>(
+                        std::min<std::size_t>(ranges.size(), sizeof(s->data) - sizeof(record) - 255));
+
+                s->kind = access_record_kind;
+                s->time_us = record.time_us;
+                std::memcpy(s->data, &record, sizeof(record));
+                std::memcpy(s->data + sizeof(record), path.data(), record.path_length);
+                std::memcpy(s->data + sizeof(record) + record.path_length, ranges.data(), record.range_length);
+                s->size = static_cast<boost::uint16_t>(sizeof(record) + record.path_length + record.range_length);
+                r.commit();
+            }
+
+            line::line(level severity) : severity_(severity), size_(0) {}
+
+            line::~line() {
+                ring &r = instance().local_ring();
+                slot *s = r.prepare();
+                if (!s) {
+                    instance().drop();
+                    return;
+                }
+                s->kind = text_record;
+                s->severity = static_cast<boost::uint8_t>(severity_);
+                s->time_us = now_us();
+                s->size = static_cast<boost::uint16_t>(size_);
+                std::memcpy(s->data, text_, size_);
+                r.commit();
+            }
+
+            line &line::operator<<(boost::string_view value) {
+                std::size_t count = std::min(value.size(), capacity - size_);
+                std::memcpy(text_ + size_, value.data(), count);
+                size_ += count;
+                return *this;
+            }
+
+            void line::append_signed(long long value) {
+                char digits[24];
+                int count = std::snprintf(digits, sizeof(digits), "%lld", value);
+                *this << boost::string_view(digits, static_cast<std::size_t>(count));
+            }
+
+            void line::append_unsigned(unsigned long long value) {
+                char digits[24];
+                int count = std::snprintf(digits, sizeof(digits), "%llu", value);
+                *this << boost::string_view(digits, static_cast<std::size_t>(count));
+            }
+
+        }
+    }
+}
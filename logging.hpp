@@ -0,0 +1,105 @@
+#ifndef HTTP_SERVER3_LOGGING_HPP
+#define HTTP_SERVER3_LOGGING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/utility/string_view.hpp>
+
+#ifndef HTTP_SERVER3_MIN_LOG_LEVEL
+#define HTTP_SERVER3_MIN_LOG_LEVEL 0
+#endif
+
+#define HTTP_SERVER3_LOG(severity, message)                                                           \
+    do {                                                                                              \
+        if (::http::server3::logging::severity >= HTTP_SERVER3_MIN_LOG_LEVEL                          \
+            && ::http::server3::logging::enabled(::http::server3::logging::severity)) {               \
+            ::http::server3::logging::line log_line_(::http::server3::logging::severity);             \
+            log_line_ << message;                                                                     \
+        }                                                                                             \
+    } while (0)
+
+namespace http {
+    namespace server3 {
+        namespace logging {
+
+            enum level {
+                debug = 0, info = 1, warning = 2, error = 3, off = 4
+            };
+
+            struct access_record {
+                boost::int64_t time_us;
+                boost::uint64_t bytes;
+                boost::uint32_t latency_us;
+                boost::uint16_t status;
+                boost::uint8_t path_length;
+                boost::uint8_t range_length;
+            };
+
+            const char access_log_magic[8] = {'H', 'S', '3', 'A', 'L', 'O', 'G', '1'};
+
+            extern std::atomic<int> threshold;
+
+            extern std::atomic<bool> access_enabled;
+
+            inline bool enabled(level severity) {
+                return severity >= threshold.load(std::memory_order_relaxed);
+            }
+
+            bool parse_level(boost::string_view name, level &severity);
+
+            void start(level severity, const std::string &access_log_path);
+
+            void stop();
+
+            void access(boost::string_view path, boost::string_view ranges, unsigned int status,
+                        unsigned long long bytes, std::chrono::steady_clock::duration latency);
+
+            class line : private boost::noncopyable {
+            public:
+                explicit line(level severity);
+
+                ~line();
+
+                line &operator<<(boost::string_view value);
+
+                line &operator<<(const char *value) {
+                    return *this << boost::string_view(value);
+                }
+
+                line &operator<<(const std::string &value) {
+                    return *this << boost::string_view(value);
+                }
+
+                template<typename T>
+                typename std::enable_if<std::is_integral<T>::value, line &>::type operator<<(T value) {
+                    if (std::is_signed<T>::value)
+                        append_signed(static_cast<long long>(value));
+                    else
+                        append_unsigned(static_cast<unsigned long long>(value));
+                    return *this;
+                }
+
+            private:
+                void append_signed(long long value);
+
+                void append_unsigned(unsigned long long value);
+
+                static const std::size_t capacity = 480;
+
+                level severity_;
+
+                std::size_t size_;
+
+                char text_[capacity];
+            };
+
+        }
+    }
+}
+
+#endif
@@ -1,16 +1,62 @@
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
 #include "server.hpp"
+#include "logging.hpp"
 
-int main() {
+int main(int argc, char *argv[]) {
     try {
-        http::server3::server s("localhost", "8080", "download", 12);
+        http::server3::server::options options;
+        http::server3::logging::level log_level = http::server3::logging::info;
+        std::string access_log;
+        std::size_t threads = 12;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "--io-uring") {
+                options.backend = http::server3::server::io_uring;
+            } else if (arg == "--thread-per-core") {
+                options.thread_per_core = true;
+                threads = std::max(1u, boost::thread::hardware_concurrency());
+            } else if (arg.compare(0, 12, "--log-level=") == 0) {
+                if (!http::server3::logging::parse_level(boost::string_view(arg).substr(12), log_level))
+                    throw std::invalid_argument("unknown log level " + arg.substr(12));
+            } else if (arg.compare(0, 13, "--access-log=") == 0) {
+                access_log = arg.substr(13);
+            } else if (arg.compare(0, 13, "--etag-index=") == 0) {
+                options.etag_index = arg.substr(13);
+            } else if (arg.compare(0, 14, "--client-rate=") == 0) {
+                options.client_rate = boost::lexical_cast<unsigned long long>(arg.substr(14));
+            } else if (arg.compare(0, 18, "--connection-rate=") == 0) {
+                options.connection_rate = boost::lexical_cast<unsigned long long>(arg.substr(18));
+            } else if (arg.compare(0, 18, "--max-connections=") == 0) {
+                options.admission.max_connections = boost::lexical_cast<unsigned long long>(arg.substr(18));
+            } else if (arg.compare(0, 21, "--max-inflight-bytes=") == 0) {
+                options.admission.max_inflight_bytes = boost::lexical_cast<unsigned long long>(arg.substr(21));
+            } else if (arg.compare(0, 21, "--max-queue-delay-ms=") == 0) {
+                options.admission.max_queue_delay = std::chrono::milliseconds(
+                        boost::lexical_cast<long long>(arg.substr(21)));
+            } else if (arg == "--http2") {
+                options.http2 = true;
+            } else if (arg == "--tls") {
+                options.tls = true;
+            } else if (arg.compare(0, 11, "--tls-cert=") == 0) {
+                options.tls_certificate = arg.substr(11);
+            } else if (arg.compare(0, 10, "--tls-key=") == 0) {
+                options.tls_key = arg.substr(10);
+            }
+        }
+
+        http::server3::logging::start(log_level, access_log);
+        http::server3::server s("localhost", "8080", "download", threads, options);
         s.run();
+        http::server3::logging::stop();
     }
     catch (std::exception &e) {
+        http::server3::logging::stop();
         std::cerr << "exception: " << e.what() << "\n";
     }
 
@@ -0,0 +1,309 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <utility>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace http {
+    namespace server3 {
+        namespace metrics {
+
+            namespace {
+
+                const unsigned int sub_bucket_bits = 7;
+
+                const unsigned int sub_bucket_half = 1u << (sub_bucket_bits - 1);
+
+                const unsigned int max_shift = 30;
+
+                const std::size_t bucket_count = sub_bucket_half * (max_shift + 2);
+
+                const unsigned int min_status = 100;
+
+                const unsigned int max_status = 599;
+
+                std::size_t bucket_index(boost::uint64_t value) {
+                    if (value < 2 * sub_bucket_half)
+                        return static_cast<std::size_t>(value);
+                    unsigned int shift = 63 - __builtin_clzll(value) - (sub_bucket_bits - 1);
+                    if (shift > max_shift)
+                        return bucket_count - 1;
+                    return shift * sub_bucket_half + static_cast<std::size_t>(value >> shift);
+                }
+
+                boost::uint64_t highest_equivalent(std::size_t index) {
+                    if (index < 2 * sub_bucket_half)
+                        return index;
+                    unsigned int shift = static_cast<unsigned int>(index / sub_bucket_half - 1);
+                    boost::uint64_t sub = index - shift * sub_bucket_half;
+                    return ((sub + 1) << shift) - 1;
+                }
+
+                typedef std::atomic<boost::uint64_t> counter;
+
+                inline void increment(counter &c, boost::uint64_t amount = 1) {
+                    c.store(c.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+                }
+
+                struct histogram {
+                    histogram() : count(0), sum_ns(0) {
+                        for (std::size_t i = 0; i < bucket_count; ++i)
+                            buckets[i].store(0, std::memory_order_relaxed);
+                    }
+
+                    counter count;
+                    counter sum_ns;
+                    counter buckets[bucket_count];
+                };
+
+                struct alignas(64) shard : private boost::noncopyable {
+                    shard() : bytes(0), abandoned_bytes(0), opened(0), closed(0) {
+                        for (unsigned int i = 0; i <= max_status - min_status; ++i)
+                            statuses[i].store(0, std::memory_order_relaxed);
+                        for (int i = 0; i < event_count; ++i)
+                            events[i].store(0, std::memory_order_relaxed);
+                    }
+
+                    counter statuses[max_status - min_status + 1];
+                    counter events[event_count];
+                    counter bytes;
+                    counter abandoned_bytes;
+                    counter opened;
+                    counter closed;
+                    histogram histograms[histogram_count];
+                };
+
+                class registry : private boost::noncopyable {
+                public:
+                    registry() : next_collector_(0) {}
+
+                    shard &local() {
+                        thread_local shard *local = 0;
+                        if (!local) {
+                            boost::shared_ptr<shard> created = boost::make_shared<shard>();
+                            boost::lock_guard<boost::mutex> lock(mutex_);
+                            shards_.push_back(created);
+                            local = created.get();
+                        }
+                        return *local;
+                    }
+
+                    std::vector<boost::shared_ptr<shard> > snapshot() {
+                        boost::lock_guard<boost::mutex> lock(mutex_);
+                        return shards_;
+                    }
+
+                    std::size_t add_collector(const collector &c) {
+                        boost::lock_guard<boost::mutex> lock(mutex_);
+                        collectors_.push_back(std::make_pair(++next_collector_, c));
+                        return next_collector_;
+                    }
+
+                    void remove_collector(std::size_t id) {
+                        boost::lock_guard<boost::mutex> lock(mutex_);
+                        for (std::size_t i = 0; i < collectors_.size(); ++i) {
+                            if (collectors_[i].first == id) {
+                                collectors_.erase(collectors_.begin() + i);
+                                return;
+                            }
+                        }
+                    }
+
+                    std::vector<std::pair<std::size_t, collector> > collectors() {
+                        boost::lock_guard<boost::mutex> lock(mutex_);
+                        return collectors_;
+                    }
+
+                private:
+                    boost::mutex mutex_;
+
+                    std::vector<boost::shared_ptr<shard> > shards_;
+
+                    std::size_t next_collector_;
+
+                    std::vector<std::pair<std::size_t, collector> > collectors_;
+                };
+
+                registry &instance() {
+                    static registry r;
+                    return r;
+                }
+
+                const char *const histogram_names[] = {
+                        "http_request_parse_seconds",
+                        "http_time_to_first_byte_seconds",
+                        "http_response_seconds"
+                };
+
+                const char *const histogram_help[] = {
+                        "Time spent parsing request headers.",
+                        "Time from a parsed request to the end of the header write.",
+                        "Time from a parsed request to the last body byte written."
+                };
+
+                const char *const event_names[] = {
+                        "http_send_window_full_total",
+                        "http_slow_requests_dropped_total",
+                        "http_slow_responses_dropped_total",
+                        "http_transfers_aborted_total",
+                        "http_disk_reads_cancelled_total",
+                        "http_bandwidth_throttled_total",
+                        "http_tls_handshake_failures_total",
+                        "http_tls_kernel_offload_total",
+                        "http_tls_userspace_encryption_total",
+                        "http2_sessions_total",
+                        "http2_streams_reset_total"
+                };
+
+                const char *const event_help[] = {
+                        "Body writes that waited for the socket to drain the send window.",
+                        "Connections closed because the request headers arrived too slowly.",
+                        "Connections closed because the client read the response below the minimum rate.",
+                        "Responses whose body was not completely sent.",
+                        "Pending file reads cancelled because the client went away.",
+                        "Body writes delayed until the client or connection bandwidth bucket refilled.",
+                        "TLS handshakes that failed or were abandoned by the client.",
+                        "TLS connections whose records are encrypted by kernel TLS, keeping sendfile.",
+                        "TLS connections encrypted in userspace because kernel TLS was unavailable.",
+                        "Connections that switched to HTTP/2.",
+                        "HTTP/2 streams cancelled by the client or refused by the server."
+                };
+
+                const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+                void append(std::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+                void append(std::string &out, const char *format, ...) {
+                    char line[256];
+                    va_list args;
+                    va_start(args, format);
+                    int size = std::vsnprintf(line, sizeof(line), format, args);
+                    va_end(args);
+                    if (size > 0)
+                        out.append(line, std::min<std::size_t>(static_cast<std::size_t>(size), sizeof(line) - 1));
+                }
+            }
+
+            void connection_opened() {
+                increment(instance().local().opened);
+            }
+
+            void connection_closed() {
+                increment(instance().local().closed);
+            }
+
+            void record_request(unsigned int status, unsigned long long bytes) {
+                shard &s = instance().local();
+                if (status >= min_status && status <= max_status)
+                    increment(s.statuses[status - min_status]);
+                increment(s.bytes, bytes);
+            }
+
+            void record_event(event_id event) {
+                increment(instance().local().events[event]);
+            }
+
+            void record_abandoned_bytes(unsigned long long bytes) {
+                increment(instance().local().abandoned_bytes, bytes);
+            }
+
+            void record_latency(histogram_id id, std::chrono::steady_clock::duration latency) {
+                long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+                boost::uint64_t value = ns > 0 ? static_cast<boost::uint64_t>(ns) : 0;
+                histogram &h = instance().local().histograms[id];
+                increment(h.buckets[bucket_index(value)]);
+                increment(h.count);
+                increment(h.sum_ns, value);
+            }
+
+            std::size_t add_collector(const collector &c) {
+                return instance().add_collector(c);
+            }
+
+            void remove_collector(std::size_t id) {
+                instance().remove_collector(id);
+            }
+
+            void render(std::string &out) {
+                std::vector<boost::shared_ptr<shard> > shards = instance().snapshot();
+
+                out += "# HELP http_requests_total Completed requests by status code.\n"
+                       "# TYPE http_requests_total counter\n";
+                for (unsigned int status = min_status; status <= max_status; ++status) {
+                    boost::uint64_t total = 0;
+                    for (std::size_t i = 0; i < shards.size(); ++i)
+                        total += shards[i]->statuses[status - min_status].load(std::memory_order_relaxed);
+                    if (total > 0)
+                        append(out, "http_requests_total{code=\"%u\"} %llu\n", status,
+                               static_cast<unsigned long long>(total));
+                }
+
+                boost::uint64_t bytes = 0, abandoned_bytes = 0, opened = 0, closed = 0;
+                for (std::size_t i = 0; i < shards.size(); ++i) {
+                    bytes += shards[i]->bytes.load(std::memory_order_relaxed);
+                    abandoned_bytes += shards[i]->abandoned_bytes.load(std::memory_order_relaxed);
+                    opened += shards[i]->opened.load(std::memory_order_relaxed);
+                    closed += shards[i]->closed.load(std::memory_order_relaxed);
+                }
+                append(out, "# HELP http_response_body_bytes_total Body bytes of completed responses.\n"
+                            "# TYPE http_response_body_bytes_total counter\n"
+                            "http_response_body_bytes_total %llu\n", static_cast<unsigned long long>(bytes));
+                append(out, "# HELP http_abandoned_response_bytes_total Response bytes left unsent by aborted responses.\n"
+                            "# TYPE http_abandoned_response_bytes_total counter\n"
+                            "http_abandoned_response_bytes_total %llu\n", static_cast<unsigned long long>(abandoned_bytes));
+                for (int id = 0; id < event_count; ++id) {
+                    boost::uint64_t total = 0;
+                    for (std::size_t i = 0; i < shards.size(); ++i)
+                        total += shards[i]->events[id].load(std::memory_order_relaxed);
+                    append(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", event_names[id], event_help[id],
+                           event_names[id], event_names[id], static_cast<unsigned long long>(total));
+                }
+                append(out, "# HELP http_active_connections Currently open client connections.\n"
+                            "# TYPE http_active_connections gauge\n"
+                            "http_active_connections %lld\n", static_cast<long long>(opened - closed));
+
+                std::vector<boost::uint64_t> buckets(bucket_count);
+                for (int id = 0; id < histogram_count; ++id) {
+                    std::fill(buckets.begin(), buckets.end(), 0);
+                    boost::uint64_t count = 0, sum_ns = 0;
+                    for (std::size_t i = 0; i < shards.size(); ++i) {
+                        const histogram &h = shards[i]->histograms[id];
+                        count += h.count.load(std::memory_order_relaxed);
+                        sum_ns += h.sum_ns.load(std::memory_order_relaxed);
+                        for (std::size_t b = 0; b < bucket_count; ++b)
+                            buckets[b] += h.buckets[b].load(std::memory_order_relaxed);
+                    }
+
+                    append(out, "# HELP %s %s\n# TYPE %s summary\n", histogram_names[id], histogram_help[id],
+                           histogram_names[id]);
+                    for (double q : quantiles) {
+                        boost::uint64_t target = static_cast<boost::uint64_t>(q * count + 0.5), seen = 0;
+                        std::size_t b = 0;
+                        for (; b < bucket_count; ++b) {
+                            seen += buckets[b];
+                            if (seen >= target && seen > 0)
+                                break;
+                        }
+                        double value = count > 0 ? highest_equivalent(std::min(b, bucket_count - 1)) / 1e9 : 0.0;
+                        append(out, "%s{quantile=\"%g\"} %.9f\n", histogram_names[id], q, value);
+                    }
+                    append(out, "%s_sum %.9f\n%s_count %llu\n", histogram_names[id], sum_ns / 1e9,
+                           histogram_names[id], static_cast<unsigned long long>(count));
+                }
+
+                std::vector<std::pair<std::size_t, collector> > collectors = instance().collectors();
+                for (std::size_t i = 0; i < collectors.size(); ++i)
+                    collectors[i].second(out);
+            }
+
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef HTTP_SERVER3_METRICS_HPP
+#define HTTP_SERVER3_METRICS_HPP
+
+#include <chrono>
+#include <string>
+#include <boost/function.hpp>
+
+namespace http {
+    namespace server3 {
+        namespace metrics {
+
+            enum histogram_id {
+                parse_time, time_to_first_byte, response_time, histogram_count
+            };
+
+            enum event_id {
+                send_window_full, slow_request_dropped, slow_response_dropped, transfer_aborted,
+                disk_read_cancelled, bandwidth_throttled, tls_handshake_failed, tls_kernel_offload, tls_userspace,
+                http2_connection, http2_stream_reset, event_count
+            };
+
+            void connection_opened();
+
+            void connection_closed();
+
+            void record_request(unsigned int status, unsigned long long bytes);
+
+            void record_event(event_id event);
+
+            void record_abandoned_bytes(unsigned long long bytes);
+
+            void record_latency(histogram_id histogram, std::chrono::steady_clock::duration latency);
+
+            typedef boost::function<void(std::string &out)> collector;
+
+            std::size_t add_collector(const collector &c);
+
+            void remove_collector(std::size_t id);
+
+            void render(std::string &out);
+
+        }
+    }
+}
+
+#endif
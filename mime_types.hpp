@@ -1,12 +1,14 @@
 #ifndef HTTP_SERVER3_MIME_TYPES_HPP
 #define HTTP_SERVER3_MIME_TYPES_HPP
 
-#include <string>
+#include <boost/utility/string_view.hpp>
 
 namespace http {
     namespace server3 {
         namespace mime_types {
-            std::string extension_to_type(const std::string &extension);
+            boost::string_view extension_to_type(boost::string_view extension);
+
+            bool is_compressible(boost::string_view content_type);
         }
     }
 }
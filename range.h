@@ -1,13 +1,17 @@
 #ifndef CPP_HTTP_RANGE_FILESERVER_RANGE_H
 #define CPP_HTTP_RANGE_FILESERVER_RANGE_H
 
+#include <algorithm>
+#include <climits>
 #include <string>
-#include <fstream>
-#include "reply.hpp"
+#include <vector>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/utility/string_view.hpp>
 
 class range {
 public:
     static const int DEFAULT_BUFFER_SIZE = 204800;
+    static const std::size_t MAX_RANGES = 100;
     unsigned long start;
     unsigned long end;
     unsigned long length;
@@ -19,31 +23,75 @@ public:
             length(end - start + 1),
             total(total) {}
 
-    static long sublong(const std::string &value, unsigned long beginIndex, unsigned long endIndex) {
-        std::string substring = value.substr(beginIndex, endIndex);
-        return (substring.length() > 0) ? std::stol(substring) : -1;
-    }
+    static bool parse(boost::string_view value, unsigned long total, std::vector<range> &ranges) {
+        if (value.size() < 6 || !boost::algorithm::iequals(value.substr(0, 6), "bytes="))
+            return false;
 
-    static void
-    copy(std::ifstream &is, http::server3::reply &rep, unsigned long inputSize, long start, unsigned long length) {
-        char buffer[DEFAULT_BUFFER_SIZE];
-        long read;
-        if (inputSize == length) {
-            while ((read = is.read(buffer, sizeof(buffer)).gcount()) > 0) {
-                rep.content.append(buffer, (unsigned long) read);
-            }
-        } else {
-            is.ignore(start);
-            unsigned long toRead = length;
-            while ((read = is.read(buffer, sizeof(buffer)).gcount()) > 0) {
-                if ((toRead -= read) > 0) {
-                    rep.content.append(buffer, (unsigned long) read);
-                } else {
-                    rep.content.append(buffer, toRead + read);
-                    break;
+        const char *position = value.data() + 6;
+        const char *end = value.data() + value.size();
+        std::size_t count = 0;
+        while (true) {
+            skip_spaces(position, end);
+            if (position != end && *position != ',') {
+                if (++count > MAX_RANGES)
+                    return false;
+
+                unsigned long first = 0, last = 0;
+                bool has_first = parse_number(position, end, first);
+                if (position == end || *position++ != '-')
+                    return false;
+                bool has_last = parse_number(position, end, last);
+                if ((!has_first && !has_last) || (has_first && has_last && last < first))
+                    return false;
+                skip_spaces(position, end);
+
+                if (!has_first) {
+                    first = last < total ? total - last : 0;
+                    has_last = false;
+                    if (last == 0)
+                        first = total;
+                }
+                if (first < total) {
+                    if (!has_last || last > total - 1)
+                        last = total - first <= DEFAULT_BUFFER_SIZE ? total - 1 : first + DEFAULT_BUFFER_SIZE;
+                    ranges.emplace_back(first, last, total);
                 }
             }
+            if (position == end)
+                break;
+            if (*position++ != ',')
+                return false;
+        }
+
+        std::sort(ranges.begin(), ranges.end(), [](const range &a, const range &b) { return a.start < b.start; });
+        std::vector<range>::iterator merged = ranges.begin();
+        for (std::vector<range>::iterator it = ranges.begin(); it != ranges.end(); ++it) {
+            if (it != ranges.begin() && it->start <= merged->end + 1) {
+                if (it->end > merged->end)
+                    *merged = range(merged->start, it->end, total);
+            } else if (it != ranges.begin()) {
+                *++merged = *it;
+            }
+        }
+        if (!ranges.empty())
+            ranges.erase(merged + 1, ranges.end());
+        return !ranges.empty();
+    }
+
+private:
+    static void skip_spaces(const char *&position, const char *end) {
+        while (position != end && (*position == ' ' || *position == '\t'))
+            ++position;
+    }
+
+    static bool parse_number(const char *&position, const char *end, unsigned long &number) {
+        const char *begin = position;
+        number = 0;
+        for (; position != end && *position >= '0' && *position <= '9'; ++position) {
+            unsigned long digit = static_cast<unsigned long>(*position - '0');
+            number = number > (ULONG_MAX - digit) / 10 ? ULONG_MAX : number * 10 + digit;
         }
+        return position != begin;
     }
 };
 
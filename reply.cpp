@@ -8,43 +8,43 @@ namespace http {
         namespace status_strings {
 
             const std::string ok =
-                    "HTTP/1.0 200 OK\r\n";
+                    "HTTP/1.1 200 OK\r\n";
             const std::string created =
-                    "HTTP/1.0 201 Created\r\n";
+                    "HTTP/1.1 201 Created\r\n";
             const std::string accepted =
-                    "HTTP/1.0 202 Accepted\r\n";
+                    "HTTP/1.1 202 Accepted\r\n";
             const std::string no_content =
-                    "HTTP/1.0 204 No Content\r\n";
+                    "HTTP/1.1 204 No Content\r\n";
             const std::string partial_content =
                     "HTTP/1.1 206 Partial Content\r\n";
             const std::string multiple_choices =
-                    "HTTP/1.0 300 Multiple Choices\r\n";
+                    "HTTP/1.1 300 Multiple Choices\r\n";
             const std::string moved_permanently =
-                    "HTTP/1.0 301 Moved Permanently\r\n";
+                    "HTTP/1.1 301 Moved Permanently\r\n";
             const std::string moved_temporarily =
-                    "HTTP/1.0 302 Moved Temporarily\r\n";
+                    "HTTP/1.1 302 Moved Temporarily\r\n";
             const std::string not_modified =
-                    "HTTP/1.0 304 Not Modified\r\n";
+                    "HTTP/1.1 304 Not Modified\r\n";
             const std::string bad_request =
-                    "HTTP/1.0 400 Bad Request\r\n";
+                    "HTTP/1.1 400 Bad Request\r\n";
             const std::string unauthorized =
-                    "HTTP/1.0 401 Unauthorized\r\n";
+                    "HTTP/1.1 401 Unauthorized\r\n";
             const std::string forbidden =
-                    "HTTP/1.0 403 Forbidden\r\n";
+                    "HTTP/1.1 403 Forbidden\r\n";
             const std::string not_found =
-                    "HTTP/1.0 404 Not Found\r\n";
+                    "HTTP/1.1 404 Not Found\r\n";
             const std::string precondition_failed =
-                    "HTTP/1.0 412 Precondition Failed\r\n";
+                    "HTTP/1.1 412 Precondition Failed\r\n";
             const std::string requested_range_not_satisfiable =
                     "HTTP/1.1 416 Range Not Satisfiable\r\n";
             const std::string internal_server_error =
-                    "HTTP/1.0 500 Internal Server Error\r\n";
+                    "HTTP/1.1 500 Internal Server Error\r\n";
             const std::string not_implemented =
-                    "HTTP/1.0 501 Not Implemented\r\n";
+                    "HTTP/1.1 501 Not Implemented\r\n";
             const std::string bad_gateway =
-                    "HTTP/1.0 502 Bad Gateway\r\n";
+                    "HTTP/1.1 502 Bad Gateway\r\n";
             const std::string service_unavailable =
-                    "HTTP/1.0 503 Service Unavailable\r\n";
+                    "HTTP/1.1 503 Service Unavailable\r\n";
 
             boost::asio::const_buffer to_buffer(reply::status_type status) {
                 switch (status) {
@@ -112,6 +112,7 @@ namespace http {
             }
             buffers.push_back(boost::asio::buffer(misc_strings::crlf));
             buffers.push_back(boost::asio::buffer(content));
+            buffers.insert(buffers.end(), body_buffers.begin(), body_buffers.end());
             return buffers;
         }
 
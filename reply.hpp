@@ -5,10 +5,19 @@
 #include <vector>
 #include <boost/asio.hpp>
 #include "header.hpp"
+#include "file_cache.hpp"
 
 namespace http {
     namespace server3 {
 
+        struct body_segment {
+            std::vector<boost::asio::const_buffer> buffers;
+
+            unsigned long long offset;
+
+            unsigned long long length;
+        };
+
         struct reply {
             enum status_type {
                 ok = 200,
@@ -36,6 +45,18 @@ namespace http {
 
             std::string content;
 
+            cached_file_ptr body_file;
+
+            unsigned long long body_offset = 0;
+
+            unsigned long long body_length = 0;
+
+            std::vector<boost::shared_ptr<const std::string> > body_chunks;
+
+            std::vector<boost::asio::const_buffer> body_buffers;
+
+            std::vector<body_segment> body_segments;
+
             std::vector<boost::asio::const_buffer> to_buffers();
 
             static reply stock_reply(status_type status);
@@ -1,18 +1,18 @@
 #ifndef HTTP_SERVER3_REQUEST_HPP
 #define HTTP_SERVER3_REQUEST_HPP
 
-#include <string>
-#include <vector>
+#include <boost/container/small_vector.hpp>
+#include <boost/utility/string_view.hpp>
 #include "header.hpp"
 
 namespace http {
     namespace server3 {
         struct request {
-            std::string method;
-            std::string uri;
+            boost::string_view method;
+            boost::string_view uri;
             int http_version_major;
             int http_version_minor;
-            std::vector<header> headers;
+            boost::container::small_vector<request_header, 32> headers;
         };
     }
 }
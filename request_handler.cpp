@@ -1,40 +1,108 @@
 #include "request_handler.hpp"
-#include <fstream>
 #include <sstream>
 #include <string>
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
-#include <iostream>
 #include "mime_types.hpp"
 #include "reply.hpp"
 #include "request.hpp"
-#include <chrono>
-#include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/date_time/posix_time/posix_time_io.hpp>
-#include <boost/date_time.hpp>
 #include "httputils.h"
+#include "http_date.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include <boost/algorithm/string/predicate.hpp>
 #include <sstream>
 #include "range.h"
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <random>
 
 namespace http {
     namespace server3 {
 
-        request_handler::request_handler(const std::string &doc_root) : doc_root_(doc_root) {}
+        namespace {
+            std::string make_boundary() {
+                static const char digits[] = "0123456789abcdef";
+                thread_local std::mt19937_64 generator(std::random_device{}());
+                unsigned long long value = generator();
+                std::string boundary(16, '0');
+                for (std::size_t i = 0; i < boundary.size(); ++i, value >>= 4)
+                    boundary[i] = digits[value & 0xf];
+                return boundary;
+            }
+
+            void collapse_separators(std::string &path) {
+                std::string::size_type out = 0;
+                for (std::string::size_type in = 0; in < path.size(); ++in) {
+                    if (path[in] == '/' && out > 0 && path[out - 1] == '/')
+                        continue;
+                    if (path[in] == '.' && out > 0 && path[out - 1] == '/'
+                        && in + 1 < path.size() && path[in + 1] == '/') {
+                        ++in;
+                        continue;
+                    }
+                    path[out++] = path[in];
+                }
+                path.resize(out);
+            }
+
+            std::string without_trailing_separators(std::string path) {
+                while (!path.empty() && path[path.size() - 1] == '/')
+                    path.resize(path.size() - 1);
+                return path;
+            }
+
+            void add_header(reply &rep, const std::string &name, const std::string &value) {
+                header h;
+                h.name = name;
+                h.value = value;
+                rep.headers.push_back(h);
+            }
+        }
+
+        request_handler::request_handler(const std::string &doc_root)
+                : doc_root_(without_trailing_separators(doc_root)),
+                  compression_cache_(chunk_cache_),
+                  async_file_io_(false),
+                  watcher_(doc_root_, boost::bind(&request_handler::invalidate, this, _1, _2),
+                           boost::bind(&file_cache::set_watched, &file_cache_, false)) {
+            file_cache_.set_watched(true);
+            if (!watcher_.complete())
+                file_cache_.set_watched(false);
+        }
+
+        void request_handler::set_async_file_io(bool enabled) {
+            async_file_io_ = enabled;
+        }
+
+        void request_handler::open_etag_index(const std::string &path) {
+            etag_index_.open(path);
+        }
+
+        void request_handler::offer_chunk(const cached_file &file, unsigned long long index, const chunk_ptr &chunk) {
+            chunk_cache_.offer(file, index, chunk);
+        }
 
         void request_handler::handle_request(const request &req, reply &rep) {
+            if (req.uri == metrics_path) {
+                metrics_reply(rep);
+                return;
+            }
+
             std::string request_path;
             if (!url_decode(req.uri, request_path)) {
                 rep = reply::stock_reply(reply::bad_request);
                 return;
             }
 
-            std::cout << "Request path: " << request_path << std::endl;
+            HTTP_SERVER3_LOG(debug, "Request path: " << request_path);
             if (request_path.empty() || request_path[0] != '/'
                 || request_path.find("..", 0) != std::string::npos) {
                 rep = reply::stock_reply(reply::bad_request);
                 return;
             }
 
+            collapse_separators(request_path);
             if (request_path[request_path.size() - 1] == '/') {
                 request_path += "index.html";
             }
@@ -47,38 +115,55 @@ namespace http {
             }
 
             std::string full_path = doc_root_ + request_path;
-            std::ifstream is(full_path.c_str(), std::ios::in | std::ios::binary);
-            if (!is) {
+            cached_file_ptr file = file_cache_.open(full_path, extension);
+            if (!file) {
                 rep = reply::stock_reply(reply::not_found);
                 return;
             }
+            std::string filename = request_path;
+            std::string content_encoding;
+            cached_file_ptr representation = file;
+            bool compress = !file->brotli && !file->gzip && compression_cache_.eligible(*file);
+            bool has_variants = file->brotli || file->gzip || compress;
+            if (has_variants) {
+                boost::string_view accept_encoding = getHeader(req, "Accept-Encoding");
+                int brotli_quality = file->brotli ? httputils::encodingQuality(accept_encoding, "br") : -1;
+                int gzip_quality = file->gzip || compress ? httputils::encodingQuality(accept_encoding, "gzip") : -1;
+                cached_file_ptr gzip = compress && gzip_quality > 0 ? compression_cache_.find_gzip(file) : file->gzip;
+                if (brotli_quality > 0 && brotli_quality >= gzip_quality) {
+                    file = representation = file->brotli;
+                    content_encoding = "br";
+                } else if (gzip_quality > 0 && gzip) {
+                    if (gzip == file->gzip)
+                        representation = gzip;
+                    file = gzip;
+                    content_encoding = "gzip";
+                }
+            }
+            boost::string_view etag_suffix = representation != file ? "-gzip" : "";
+            std::string etag = etag_index_.find(representation, etag_suffix);
+            std::string validator = etag_index::validator(*representation, etag_suffix);
 
-            std::ifstream in(full_path.c_str(), std::ifstream::ate | std::ifstream::binary);
-            long long int length = in.tellg();
-            in.close();
-
-            std::cout << "File size: " << length << std::endl;
+            long long int length = file->size;
 
-            std::string filename = request_path;
+            HTTP_SERVER3_LOG(debug, "File size: " << length);
 
-            struct stat info;
-            stat("/etc", &info);
-            long long int modification_ms = info.st_mtimespec.tv_sec * 1000 + info.st_mtimespec.tv_nsec / 1000000;
-            std::cout << "File last modified time: " << modification_ms << std::endl;
-            long long int ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch()).count();
-            std::cout << "Current time millis: " << ms << std::endl;
-            std::string content_type = mime_types::extension_to_type(extension);
-            std::cout << "File content type: " << content_type << std::endl;
+            long long int modification_ms = file->modification_ms;
+            HTTP_SERVER3_LOG(debug, "File last modified time: " << modification_ms);
+            std::string content_type = file->content_type;
+            HTTP_SERVER3_LOG(debug, "File content type: " << content_type);
 
-            std::string if_none_match_header = getHeader(req, "If-None-Match");
+            boost::string_view if_none_match_header = getHeader(req, "If-None-Match");
 
-            if (!if_none_match_header.empty() && httputils::matches(if_none_match_header, filename)) {
+            if (!if_none_match_header.empty() && (httputils::matches(if_none_match_header, etag, true)
+                                                  || httputils::matches(if_none_match_header, validator, true))) {
                 rep.status = reply::not_modified;
                 rep.headers.resize(1);
                 rep.headers[0].name = "ETag";
-                rep.headers[0].value = filename;
-                std::cout << "Status 'Not modified' because 'If-None-Match' condition" << std::endl;
+                rep.headers[0].value = etag;
+                if (has_variants)
+                    add_header(rep, "Vary", "Accept-Encoding");
+                HTTP_SERVER3_LOG(debug, "Status 'Not modified' because 'If-None-Match' condition");
                 return;
             }
 
@@ -88,22 +173,24 @@ namespace http {
                 rep.status = reply::not_modified;
                 rep.headers.resize(1);
                 rep.headers[0].name = "ETag";
-                rep.headers[0].value = filename;
-                std::cout << "Status 'Not modified' because 'If-Modified-Since' condition" << std::endl;
+                rep.headers[0].value = etag;
+                if (has_variants)
+                    add_header(rep, "Vary", "Accept-Encoding");
+                HTTP_SERVER3_LOG(debug, "Status 'Not modified' because 'If-Modified-Since' condition");
                 return;
             }
 
-            std::string if_match = getHeader(req, "If-Match");
-            if (!if_match.empty() && !httputils::matches(if_match, filename)) {
+            boost::string_view if_match = getHeader(req, "If-Match");
+            if (!if_match.empty() && !httputils::matches(if_match, etag) && !httputils::matches(if_match, validator)) {
                 rep = reply::stock_reply(reply::precondition_failed);
-                std::cout << "Status 'Precondition failed' because 'If-Match' condition" << std::endl;
+                HTTP_SERVER3_LOG(debug, "Status 'Precondition failed' because 'If-Match' condition");
                 return;
             }
 
             long long int if_unmodified_since = getDateHeader(req, "If-Unmodified-Since");
             if (if_unmodified_since != -1 && if_unmodified_since + 1000 <= modification_ms) {
                 rep = reply::stock_reply(reply::precondition_failed);
-                std::cout << "Status 'Precondition failed' because 'If-Unmodified-Since' condition" << std::endl;
+                HTTP_SERVER3_LOG(debug, "Status 'Precondition failed' because 'If-Unmodified-Since' condition");
                 return;
             }
 
@@ -111,58 +198,26 @@ namespace http {
 
             std::vector<range> ranges;
 
-            std::string range_value = getHeader(req, "Range");
+            boost::string_view range_value = getHeader(req, "Range");
             if (!range_value.empty()) {
-                if (!std::regex_match(range_value, std::regex("^bytes=\\d*-\\d*(,\\d*-\\d*)*$"))) {
-                    rep.status = reply::requested_range_not_satisfiable;
-                    rep.headers.resize(1);
-                    rep.headers[0].name = "Content-Range";
-                    rep.headers[0].value = "bytes */" + std::to_string(length);
-                    return;
-                }
-
-                std::string if_range = getHeader(req, "If-Range");
-                if (!if_range.empty() && if_range != filename) {
+                bool range_applies = true;
+                boost::string_view if_range = getHeader(req, "If-Range");
+                if (!if_range.empty() && if_range != etag && if_range != validator) {
                     long long int if_range_time = getDateHeader(req, "If-Range");
-                    if (if_range_time != -1) {
-                        std::cout << "Returning full range because 'If-Range' condition" << std::endl;
-                        ranges.push_back(full);
+                    if (if_range_time == -1 || if_range_time / 1000 != modification_ms / 1000) {
+                        HTTP_SERVER3_LOG(debug, "Returning full range because 'If-Range' condition");
+                        range_applies = false;
                     }
                 }
 
-                if (ranges.empty()) {
-                    std::vector<std::string> parts;
-                    httputils::split(range_value.substr(6), parts, ",");
-
-                    for (const std::string &part: parts) {
-                        long start = range::sublong(part, 0, part.find("-", 0));
-                        long end = range::sublong(part, part.find("-", 0) + 1, part.length());
-
-                        std::cout << "ORIGINAL START: " << start << std::endl;
-                        std::cout << "ORIGINAL END: " << end << std::endl;
-
-                        if (start == -1) {
-                            start = length - end;
-                            if (length - start < range::DEFAULT_BUFFER_SIZE) {
-                                end = length - 1;
-                            } else
-                                end = start + range::DEFAULT_BUFFER_SIZE;
-                        } else if (end == -1 || end > length - 1) {
-                            if (length - start < range::DEFAULT_BUFFER_SIZE) {
-                                end = length - 1;
-                            } else
-                                end = start + range::DEFAULT_BUFFER_SIZE;
-                        }
-
-                        if (start > end) {
-                            rep.status = reply::requested_range_not_satisfiable;
-                            rep.headers.resize(1);
-                            rep.headers[0].name = "Content-Range";
-                            rep.headers[0].value = "bytes */" + std::to_string(length);
-                            return;
-                        }
-                        ranges.emplace_back(range(start, end, length));
-                    }
+                if (range_applies && !range::parse(range_value, length, ranges)) {
+                    rep.status = reply::requested_range_not_satisfiable;
+                    rep.headers.resize(2);
+                    rep.headers[0].name = "Content-Range";
+                    rep.headers[0].value = "bytes */" + std::to_string(length);
+                    rep.headers[1].name = "Content-Length";
+                    rep.headers[1].value = "0";
+                    return;
                 }
             }
 
@@ -171,11 +226,11 @@ namespace http {
             if (content_type.empty())
                 content_type = "application/octet-stream";
             else if (content_type.rfind("image", 0) != 0) {
-                std::string accept = getHeader(req, "Accept");
+                boost::string_view accept = getHeader(req, "Accept");
                 disposition = !accept.empty() && httputils::accepts(accept, content_type) ? "inline" : "attachment";
             }
 
-            std::cout << "Content-Type: " << content_type << std::endl;
+            HTTP_SERVER3_LOG(debug, "Content-Type: " << content_type);
             rep.headers.resize(8);
             rep.headers[0].name = "Content-Type";
             rep.headers[0].value = content_type;
@@ -183,96 +238,205 @@ namespace http {
             rep.headers[1].name = "Content-Disposition";
             rep.headers[1].value = disposition + ";filename=\"" + filename + "\"";
 
-            std::cout << "Content-Disposition: " << disposition << std::endl;
+            HTTP_SERVER3_LOG(debug, "Content-Disposition: " << disposition);
 
             rep.headers[2].name = "Accept-Ranges";
             rep.headers[2].value = "bytes";
 
             rep.headers[3].name = "ETag";
-            rep.headers[3].value = filename;
+            rep.headers[3].value = etag;
 
             rep.headers[4].name = "Last-Modified";
-            rep.headers[4].value = std::to_string(modification_ms);
-
-            long long int ms1 = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch()).count();
+            rep.headers[4].value = http_date::format(modification_ms / 1000);
 
             rep.headers[5].name = "Expires";
-            rep.headers[5].value = std::to_string(ms1 + 604800000L);
+            rep.headers[5].value = http_date::now()->expires;
 
-            if (ranges.empty() || &ranges.at(0) == &full) {
-                std::cout << "Returning full file" << std::endl;
+            if (ranges.empty()) {
+                HTTP_SERVER3_LOG(debug, "Returning full file");
                 rep.status = reply::ok;
                 rep.headers[6].name = "Content-Range";
                 rep.headers[6].value = "bytes " + std::to_string(full.start) + "-" + std::to_string(full.end) + "/" +
                                        std::to_string(full.total);
                 rep.headers[7].name = "Content-Length";
                 rep.headers[7].value = std::to_string(full.length);
-                range::copy(is, rep, length, full.start, full.length);
+                set_body(file, full.start, full.length, rep);
             } else if (ranges.size() == 1) {
                 range r = ranges.at(0);
-                std::cout << "Return 1 part of file : from " << r.start << " to " << r.end << std::endl;
+                HTTP_SERVER3_LOG(debug, "Return 1 part of file : from " << r.start << " to " << r.end);
                 rep.headers[6].name = "Content-Range";
                 rep.headers[6].value = "bytes " + std::to_string(r.start) + "-" + std::to_string(r.end) + "/" +
                                        std::to_string(r.total);
                 rep.headers[7].name = "Content-Length";
                 rep.headers[7].value = std::to_string(r.length);
                 rep.status = reply::partial_content;
-                range::copy(is, rep, length, r.start, r.length);
+                set_body(file, r.start, r.length, rep);
             } else {
                 rep.headers[0].name = "Content-Type";
-                rep.headers[0].value = "multipart/byteranges; boundary=MULTIPART_BYTERANGES";
+                std::string boundary = make_boundary();
+                rep.headers[0].value = "multipart/byteranges; boundary=" + boundary;
                 rep.status = reply::partial_content;
-                for (range r : ranges) {
-                    std::cout << "Return multi part of file : from " << r.start << " to " << r.end;
-                    rep.content.append("\n");
-                    rep.content.append("--MULTIPART_BYTERANGES\n");
-                    rep.content.append("Content-Type: " + content_type + "\n");
-                    rep.content.append(
-                            "Content-Range: bytes " + std::to_string(r.start) + "-" + std::to_string(r.end) + "/" +
-                            std::to_string(r.total));
-                    range::copy(is, rep, length, r.start, r.length);
+                rep.body_file = file;
+                unsigned long long content_length = 0;
+                for (const range &r : ranges) {
+                    HTTP_SERVER3_LOG(debug, "Return multi part of file : from " << r.start << " to " << r.end);
+                    chunk_ptr part_header = boost::make_shared<const std::string>(
+                            (content_length == 0 ? "--" : "\r\n--") + boundary + "\r\nContent-Type: " + content_type
+                            + "\r\nContent-Range: bytes " + std::to_string(r.start) + "-" + std::to_string(r.end) + "/"
+                            + std::to_string(r.total) + "\r\n\r\n");
+                    append_segment(file, part_header, r.start, r.length, rep);
+                    content_length += part_header->size() + r.length;
                 }
+                chunk_ptr closing = boost::make_shared<const std::string>("\r\n--" + boundary + "--\r\n");
+                append_segment(file, closing, 0, 0, rep);
+                content_length += closing->size();
+
+                rep.headers.resize(7);
+                rep.headers[6].name = "Content-Length";
+                rep.headers[6].value = std::to_string(content_length);
             }
+
+            if (!content_encoding.empty())
+                add_header(rep, "Content-Encoding", content_encoding);
+            if (has_variants)
+                add_header(rep, "Vary", "Accept-Encoding");
         }
 
-        std::string request_handler::getHeader(const request &req, const std::string &name) {
-            for (http::server3::header header1: req.headers) {
-                if (header1.name == name) {
-                    return header1.value;
+        void request_handler::set_body(const cached_file_ptr &file, unsigned long long start, unsigned long long length,
+                                       reply &rep) {
+            if (length <= chunk_cache::max_cached_range
+                && load_chunks(file, start, length, rep.body_chunks, rep.body_buffers))
+                return;
+
+            rep.body_chunks.clear();
+            rep.body_buffers.clear();
+            rep.body_file = file;
+            rep.body_offset = start;
+            rep.body_length = length;
+        }
+
+        void request_handler::append_segment(const cached_file_ptr &file, const chunk_ptr &part_header,
+                                             unsigned long long start, unsigned long long length, reply &rep) {
+            if (rep.body_segments.empty() || rep.body_segments.back().length > 0)
+                rep.body_segments.push_back(body_segment());
+            body_segment &segment = rep.body_segments.back();
+            rep.body_chunks.push_back(part_header);
+            segment.buffers.push_back(boost::asio::buffer(*part_header));
+            segment.offset = start;
+            segment.length = 0;
+
+            std::size_t chunk_count = rep.body_chunks.size(), buffer_count = segment.buffers.size();
+            if (length <= chunk_cache::max_cached_range
+                && load_chunks(file, start, length, rep.body_chunks, segment.buffers))
+                return;
+
+            rep.body_chunks.resize(chunk_count);
+            segment.buffers.resize(buffer_count);
+            segment.length = length;
+        }
+
+        bool request_handler::load_chunks(const cached_file_ptr &file, unsigned long long start, unsigned long long length,
+                                          std::vector<chunk_ptr> &chunks,
+                                          std::vector<boost::asio::const_buffer> &buffers) {
+            if (length == 0)
+                return true;
+
+            unsigned long long end = start + length;
+            bool complete = true;
+            for (unsigned long long index = start / chunk_cache::chunk_size;
+                 index * chunk_cache::chunk_size < end; ++index) {
+                chunk_ptr chunk = chunk_cache_.find(*file, index);
+                unsigned long long chunk_start = index * chunk_cache::chunk_size;
+                if (!chunk || chunk_start + chunk->size() < std::min<unsigned long long>(end, chunk_start + chunk_cache::chunk_size)) {
+                    if (!async_file_io_)
+                        chunk_cache_.prefetch(file, index);
+                    complete = false;
+                    continue;
+                }
+
+                if (complete) {
+                    unsigned long long from = std::max(start, chunk_start) - chunk_start;
+                    unsigned long long to = std::min<unsigned long long>(end, chunk_start + chunk->size()) - chunk_start;
+                    buffers.push_back(boost::asio::buffer(chunk->data() + from, to - from));
+                    chunks.push_back(chunk);
                 }
             }
-            return "";
+            return complete;
         }
 
-        long long int request_handler::getDateHeader(const request &req, const std::string &name) {
-            for (http::server3::header header1: req.headers) {
-                if (header1.name == name) {
-                    boost::posix_time::ptime pt;
-                    {
-                        std::istringstream iss(header1.value);
-                        auto *f = new boost::posix_time::time_input_facet("%a, %d %b %Y %H:%M:%S %Z *!");
-                        std::locale loc(std::locale(""), f);
-                        iss.imbue(loc);
-                        iss >> pt;
-                    }
-                    return (pt - boost::posix_time::ptime{{1970, 1, 1},
-                                                          {}}).total_milliseconds();
+        void request_handler::invalidate(const std::string &path, bool tree) {
+            HTTP_SERVER3_LOG(debug, "Invalidating " << path << (tree ? "/*" : ""));
+            if (tree) {
+                std::vector<cached_file_ptr> removed = file_cache_.invalidate_tree(path);
+                for (const cached_file_ptr &file : removed)
+                    forget(file);
+                return;
+            }
+
+            forget(file_cache_.invalidate(path));
+            if (boost::algorithm::ends_with(path, ".br") || boost::algorithm::ends_with(path, ".gz"))
+                forget(file_cache_.invalidate(path.substr(0, path.size() - 3)));
+        }
+
+        void request_handler::forget(const cached_file_ptr &file) {
+            if (!file)
+                return;
+            chunk_cache_.invalidate(*file);
+            if (cached_file_ptr variant = compression_cache_.invalidate(*file))
+                chunk_cache_.invalidate(*variant);
+            if (file->brotli)
+                chunk_cache_.invalidate(*file->brotli);
+            if (file->gzip)
+                chunk_cache_.invalidate(*file->gzip);
+        }
+
+        boost::string_view request_handler::getHeader(const request &req, boost::string_view name) {
+            for (const request_header &header1: req.headers) {
+                if (boost::algorithm::iequals(header1.name, name)) {
+                    return header1.value;
                 }
             }
+            return boost::string_view();
+        }
+
+        void request_handler::metrics_reply(reply &rep) {
+            rep.status = reply::ok;
+            metrics::render(rep.content);
+            rep.content += "# HELP chunk_cache_hits_total Chunk cache hits.\n# TYPE chunk_cache_hits_total counter\n"
+                           "chunk_cache_hits_total " + std::to_string(chunk_cache_.hits()) + "\n";
+            rep.content += "# HELP chunk_cache_misses_total Chunk cache misses.\n# TYPE chunk_cache_misses_total counter\n"
+                           "chunk_cache_misses_total " + std::to_string(chunk_cache_.misses()) + "\n";
+            rep.content += "# HELP chunk_cache_evictions_total Chunks evicted.\n# TYPE chunk_cache_evictions_total counter\n"
+                           "chunk_cache_evictions_total " + std::to_string(chunk_cache_.evictions()) + "\n";
+            rep.content += "# HELP chunk_cache_rejections_total Chunks refused admission.\n"
+                           "# TYPE chunk_cache_rejections_total counter\n"
+                           "chunk_cache_rejections_total " + std::to_string(chunk_cache_.rejections()) + "\n";
+            rep.content += "# HELP chunk_cache_bytes Bytes held by the chunk cache.\n# TYPE chunk_cache_bytes gauge\n"
+                           "chunk_cache_bytes " + std::to_string(chunk_cache_.size_bytes()) + "\n";
+            rep.headers.resize(2);
+            rep.headers[0].name = "Content-Length";
+            rep.headers[0].value = std::to_string(rep.content.size());
+            rep.headers[1].name = "Content-Type";
+            rep.headers[1].value = "text/plain; version=0.0.4";
+        }
+
+        long long int request_handler::getDateHeader(const request &req, boost::string_view name) {
+            long long seconds;
+            if (http_date::parse(getHeader(req, name), seconds))
+                return seconds * 1000;
             return -1;
         }
 
-        bool request_handler::url_decode(const std::string &in, std::string &out) {
+        bool request_handler::url_decode(boost::string_view in, std::string &out) {
             out.clear();
             out.reserve(in.size());
             for (std::size_t i = 0; i < in.size(); ++i) {
                 if (in[i] == '%') {
                     if (i + 3 <= in.size()) {
-                        int value = 0;
-                        std::istringstream is(in.substr(i + 1, 2));
-                        if (is >> std::hex >> value) {
-                            out += static_cast<char>(value);
+                        int high = hex_value(in[i + 1]);
+                        int low = hex_value(in[i + 2]);
+                        if (high >= 0 && low >= 0) {
+                            out += static_cast<char>(high * 16 + low);
                             i += 2;
                         } else {
                             return false;
@@ -289,5 +453,15 @@ namespace http {
             return true;
         }
 
+        int request_handler::hex_value(char c) {
+            if (c >= '0' && c <= '9')
+                return c - '0';
+            if (c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+            return -1;
+        }
+
     }
 }
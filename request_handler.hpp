@@ -3,6 +3,14 @@
 
 #include <string>
 #include <boost/noncopyable.hpp>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/utility/string_view.hpp>
+#include "file_cache.hpp"
+#include "chunk_cache.hpp"
+#include "compression_cache.hpp"
+#include "etag_index.hpp"
+#include "file_watcher.hpp"
 
 namespace http {
     namespace server3 {
@@ -12,18 +20,54 @@ namespace http {
 
         class request_handler : private boost::noncopyable {
         public:
+            static constexpr const char *metrics_path = "/metrics";
+
             explicit request_handler(const std::string &doc_root);
 
             void handle_request(const request &req, reply &rep);
 
+            void set_async_file_io(bool enabled);
+
+            void open_etag_index(const std::string &path);
+
+            void offer_chunk(const cached_file &file, unsigned long long index, const chunk_ptr &chunk);
+
         private:
             std::string doc_root_;
 
-            static bool url_decode(const std::string &in, std::string &out);
+            file_cache file_cache_;
+
+            chunk_cache chunk_cache_;
+
+            compression_cache compression_cache_;
+
+            etag_index etag_index_;
+
+            bool async_file_io_;
+
+            file_watcher watcher_;
+
+            void invalidate(const std::string &path, bool tree);
+
+            void forget(const cached_file_ptr &file);
+
+            void metrics_reply(reply &rep);
+
+            void set_body(const cached_file_ptr &file, unsigned long long start, unsigned long long length, reply &rep);
+
+            void append_segment(const cached_file_ptr &file, const chunk_ptr &part_header, unsigned long long start,
+                                unsigned long long length, reply &rep);
+
+            bool load_chunks(const cached_file_ptr &file, unsigned long long start, unsigned long long length,
+                             std::vector<chunk_ptr> &chunks, std::vector<boost::asio::const_buffer> &buffers);
+
+            static bool url_decode(boost::string_view in, std::string &out);
+
+            static int hex_value(char c);
 
-            static std::string getHeader(const request &req, const std::string &name);
+            static boost::string_view getHeader(const request &req, boost::string_view name);
 
-            static long long int getDateHeader(const request &req, const std::string &name);
+            static long long int getDateHeader(const request &req, boost::string_view name);
         };
 
     }
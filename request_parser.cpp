@@ -1,5 +1,6 @@
 #include "request_parser.hpp"
 #include "request.hpp"
+#include "char_scanner.hpp"
 
 namespace http {
     namespace server3 {
@@ -12,14 +13,59 @@ namespace http {
             state_ = method_start;
         }
 
-        boost::tribool request_parser::consume(request &req, char input) {
+        boost::tuple<boost::tribool, char *> request_parser::parse(request &req, char *begin, char *end) {
+            while (begin != end) {
+                const char *run_end = begin;
+                switch (state_) {
+                    case method:
+                        run_end = char_scanner::find_token_end(begin, end);
+                        extend(req.method, begin, run_end);
+                        break;
+                    case uri:
+                        run_end = char_scanner::find_uri_end(begin, end);
+                        extend(req.uri, begin, run_end);
+                        break;
+                    case header_name:
+                        run_end = char_scanner::find_token_end(begin, end);
+                        extend(req.headers.back().name, begin, run_end);
+                        break;
+                    case header_value:
+                        run_end = char_scanner::find_value_end(begin, end);
+                        extend(req.headers.back().value, begin, run_end);
+                        break;
+                    default:
+                        break;
+                }
+                begin += run_end - begin;
+                if (begin == end)
+                    break;
+
+                boost::tribool result = consume(req, begin++);
+                if (result || !result)
+                    return boost::make_tuple(result, begin);
+            }
+            boost::tribool result = boost::indeterminate;
+            return boost::make_tuple(result, begin);
+        }
+
+        void request_parser::extend(boost::string_view &view, const char *begin, const char *end) {
+            if (begin == end)
+                return;
+            if (view.data() == 0)
+                view = boost::string_view(begin, end - begin);
+            else
+                view = boost::string_view(view.data(), end - view.data());
+        }
+
+        boost::tribool request_parser::consume(request &req, char *position) {
+            char input = *position;
             switch (state_) {
                 case method_start:
                     if (!is_char(input) || is_ctl(input) || is_tspecial(input)) {
                         return false;
                     } else {
                         state_ = method;
-                        req.method.push_back(input);
+                        extend(req.method, position, position + 1);
                         return boost::indeterminate;
                     }
                 case method:
@@ -29,7 +75,7 @@ namespace http {
                     } else if (!is_char(input) || is_ctl(input) || is_tspecial(input)) {
                         return false;
                     } else {
-                        req.method.push_back(input);
+                        extend(req.method, position, position + 1);
                         return boost::indeterminate;
                     }
                 case uri:
@@ -39,7 +85,7 @@ namespace http {
                     } else if (is_ctl(input)) {
                         return false;
                     } else {
-                        req.uri.push_back(input);
+                        extend(req.uri, position, position + 1);
                         return boost::indeterminate;
                     }
                 case http_version_h:
@@ -127,13 +173,16 @@ namespace http {
                         state_ = expecting_newline_3;
                         return boost::indeterminate;
                     } else if (!req.headers.empty() && (input == ' ' || input == '\t')) {
+                        position[-2] = ' ';
+                        position[-1] = ' ';
+                        extend(req.headers.back().value, position - 2, position + 1);
                         state_ = header_lws;
                         return boost::indeterminate;
                     } else if (!is_char(input) || is_ctl(input) || is_tspecial(input)) {
                         return false;
                     } else {
-                        req.headers.push_back(header());
-                        req.headers.back().name.push_back(input);
+                        req.headers.push_back(request_header());
+                        extend(req.headers.back().name, position, position + 1);
                         state_ = header_name;
                         return boost::indeterminate;
                     }
@@ -142,12 +191,13 @@ namespace http {
                         state_ = expecting_newline_2;
                         return boost::indeterminate;
                     } else if (input == ' ' || input == '\t') {
+                        extend(req.headers.back().value, position, position + 1);
                         return boost::indeterminate;
                     } else if (is_ctl(input)) {
                         return false;
                     } else {
                         state_ = header_value;
-                        req.headers.back().value.push_back(input);
+                        extend(req.headers.back().value, position, position + 1);
                         return boost::indeterminate;
                     }
                 case header_name:
@@ -157,7 +207,7 @@ namespace http {
                     } else if (!is_char(input) || is_ctl(input) || is_tspecial(input)) {
                         return false;
                     } else {
-                        req.headers.back().name.push_back(input);
+                        extend(req.headers.back().name, position, position + 1);
                         return boost::indeterminate;
                     }
                 case space_before_header_value:
@@ -174,7 +224,7 @@ namespace http {
                     } else if (is_ctl(input)) {
                         return false;
                     } else {
-                        req.headers.back().value.push_back(input);
+                        extend(req.headers.back().value, position, position + 1);
                         return boost::indeterminate;
                     }
                 case expecting_newline_2:
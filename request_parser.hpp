@@ -3,6 +3,7 @@
 
 #include <boost/logic/tribool.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <boost/utility/string_view.hpp>
 
 namespace http {
     namespace server3 {
@@ -15,19 +16,14 @@ namespace http {
 
             void reset();
 
-            template<typename InputIterator>
-            boost::tuple<boost::tribool, InputIterator> parse(request &req, InputIterator begin, InputIterator end) {
-                while (begin != end) {
-                    boost::tribool result = consume(req, *begin++);
-                    if (result || !result)
-                        return boost::make_tuple(result, begin);
-                }
-                boost::tribool result = boost::indeterminate;
-                return boost::make_tuple(result, begin);
-            }
+            // The request's fields are views into [begin, end), so every call for one request
+            // must pass the continuation of the same contiguous buffer.
+            boost::tuple<boost::tribool, char *> parse(request &req, char *begin, char *end);
 
         private:
-            boost::tribool consume(request &req, char input);
+            boost::tribool consume(request &req, char *position);
+
+            static void extend(boost::string_view &view, const char *begin, const char *end);
 
             static bool is_char(int c);
 
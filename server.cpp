@@ -3,12 +3,15 @@
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 #include <vector>
+#include <algorithm>
+#include "logging.hpp"
 
 namespace http {
     namespace server3 {
 
         server::server(const std::string &address, const std::string &port,
-                       const std::string &doc_root, std::size_t thread_pool_size)
+                       const std::string &doc_root, std::size_t thread_pool_size,
+                       const options &opts)
                 : thread_pool_size_(thread_pool_size),
                   signals_(io_context_),
                   acceptor_(io_context_),
@@ -21,23 +24,74 @@ namespace http {
 #endif
             signals_.async_wait(boost::bind(&server::handle_stop, this));
 
+            if (!opts.etag_index.empty())
+                request_handler_.open_etag_index(opts.etag_index);
+
+            if (opts.admission.max_connections > 0 || opts.admission.max_inflight_bytes > 0
+                || opts.admission.max_queue_delay.count() > 0)
+                admission_.reset(new admission_control(opts.admission));
+            if (opts.tls || !opts.tls_certificate.empty())
+                tls_.reset(new tls_context(opts.tls_certificate, opts.tls_key));
+            if (tls_ && opts.http2)
+                tls_->enable_http2();
+            if (opts.client_rate > 0 || opts.connection_rate > 0)
+                shaper_.reset(new bandwidth_shaper(io_context_, opts.client_rate, opts.connection_rate));
+
             boost::asio::ip::tcp::resolver resolver(io_context_);
             boost::asio::ip::tcp::endpoint endpoint =
                     *resolver.resolve(address, port).begin();
+
+            if (opts.thread_per_core) {
+                for (std::size_t i = 0; i < thread_pool_size_; ++i)
+                    workers_.push_back(boost::shared_ptr<worker>(
+                            new worker(endpoint, request_handler_, opts.backend == io_uring, shaper_.get(),
+                                       admission_.get(), tls_.get(), opts.http2)));
+                request_handler_.set_async_file_io(workers_[0]->has_io_uring());
+                return;
+            }
+
+            if (opts.backend == io_uring) {
+#if defined(__linux__)
+                try {
+                    io_uring_.reset(new io_uring_service(io_context_));
+                    request_handler_.set_async_file_io(true);
+                }
+                catch (boost::system::system_error &e) {
+                    HTTP_SERVER3_LOG(warning, "io_uring unavailable (" << e.what() << "), using the reactor backend");
+                }
+#else
+                HTTP_SERVER3_LOG(warning, "io_uring is only available on Linux, using the reactor backend");
+#endif
+            }
+
             acceptor_.open(endpoint.protocol());
             acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
             acceptor_.bind(endpoint);
             acceptor_.listen();
 
+            if (admission_)
+                probe_.reset(new admission_control::probe(*admission_, io_context_));
+            connections_.reset(new connection_pool(io_context_, request_handler_, io_uring_.get(), false, shaper_.get(),
+                                                   admission_.get(), tls_.get(), opts.http2));
             start_accept();
         }
 
         void server::run() {
             std::vector<boost::shared_ptr<boost::thread> > threads;
-            for (std::size_t i = 0; i < thread_pool_size_; ++i) {
-                boost::shared_ptr<boost::thread> thread(new boost::thread(
-                        boost::bind(&boost::asio::io_context::run, &io_context_)));
-                threads.push_back(thread);
+            if (!workers_.empty()) {
+                std::size_t cpus = std::max(1u, boost::thread::hardware_concurrency());
+                for (std::size_t i = 0; i < workers_.size(); ++i) {
+                    boost::shared_ptr<boost::thread> thread(new boost::thread(
+                            boost::bind(&worker::run, workers_[i], i % cpus)));
+                    threads.push_back(thread);
+                }
+                io_context_.run();
+            } else {
+                for (std::size_t i = 0; i < thread_pool_size_; ++i) {
+                    boost::shared_ptr<boost::thread> thread(new boost::thread(
+                            boost::bind(&boost::asio::io_context::run, &io_context_)));
+                    threads.push_back(thread);
+                }
             }
 
             for (std::size_t i = 0; i < threads.size(); ++i)
@@ -45,10 +99,11 @@ namespace http {
         }
 
         void server::start_accept() {
-            new_connection_.reset(new connection(io_context_, request_handler_));
+            new_connection_ = connections_->acquire();
             acceptor_.async_accept(new_connection_->socket(),
-                                   boost::bind(&server::handle_accept, this,
-                                               boost::asio::placeholders::error));
+                                   make_custom_alloc_handler(accept_memory_,
+                                                             boost::bind(&server::handle_accept, this,
+                                                                         boost::asio::placeholders::error)));
         }
 
         void server::handle_accept(const boost::system::error_code &e) {
@@ -61,6 +116,8 @@ namespace http {
 
         void server::handle_stop() {
             io_context_.stop();
+            for (std::size_t i = 0; i < workers_.size(); ++i)
+                workers_[i]->stop();
         }
 
     }
@@ -6,8 +6,16 @@
 #include <vector>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include "connection.hpp"
+#include "connection_pool.hpp"
+#include "handler_allocator.hpp"
 #include "request_handler.hpp"
+#include "io_uring_service.hpp"
+#include "worker.hpp"
+#include "bandwidth_shaper.hpp"
+#include "admission_control.hpp"
+#include "tls_context.hpp"
 
 namespace http {
     namespace server3 {
@@ -15,8 +23,39 @@ namespace http {
         class server
                 : private boost::noncopyable {
         public:
+            enum io_backend {
+                reactor,
+                io_uring
+            };
+
+            struct options {
+                options() : backend(reactor), thread_per_core(false), client_rate(0), connection_rate(0), tls(false),
+                            http2(false) {}
+
+                io_backend backend;
+
+                bool thread_per_core;
+
+                std::string etag_index;
+
+                unsigned long long client_rate;
+
+                unsigned long long connection_rate;
+
+                admission_control::limits admission;
+
+                bool tls;
+
+                std::string tls_certificate;
+
+                std::string tls_key;
+
+                bool http2;
+            };
+
             explicit server(const std::string &address, const std::string &port,
-                            const std::string &doc_root, std::size_t thread_pool_size);
+                            const std::string &doc_root, std::size_t thread_pool_size,
+                            const options &opts = options());
 
             void run();
 
@@ -29,8 +68,16 @@ namespace http {
 
             std::size_t thread_pool_size_;
 
+            handler_memory accept_memory_;
+
+            boost::scoped_ptr<admission_control> admission_;
+
+            boost::scoped_ptr<tls_context> tls_;
+
             boost::asio::io_context io_context_;
 
+            boost::scoped_ptr<admission_control::probe> probe_;
+
             boost::asio::signal_set signals_;
 
             boost::asio::ip::tcp::acceptor acceptor_;
@@ -38,6 +85,14 @@ namespace http {
             connection_ptr new_connection_;
 
             request_handler request_handler_;
+
+            boost::scoped_ptr<io_uring_service> io_uring_;
+
+            boost::scoped_ptr<connection_pool> connections_;
+
+            std::vector<boost::shared_ptr<worker> > workers_;
+
+            boost::scoped_ptr<bandwidth_shaper> shaper_;
         };
 
     }
@@ -0,0 +1,121 @@
+#include "tls_context.hpp"
+#include <ctime>
+#include <boost/asio/ssl/error.hpp>
+#include <boost/system/system_error.hpp>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/x509v3.h>
+#include "logging.hpp"
+
+namespace http {
+    namespace server3 {
+
+        namespace {
+            const long self_signed_days = 30;
+
+            void check(bool ok, const char *what) {
+                if (!ok) {
+                    boost::system::error_code ec(static_cast<int>(ERR_get_error()),
+                                                 boost::asio::error::get_ssl_category());
+                    ERR_clear_error();
+                    throw boost::system::system_error(ec, what);
+                }
+            }
+
+            void add_extension(X509 *certificate, int nid, const char *value) {
+                X509V3_CTX ctx;
+                X509V3_set_ctx_nodb(&ctx);
+                X509V3_set_ctx(&ctx, certificate, certificate, 0, 0, 0);
+                X509_EXTENSION *extension = X509V3_EXT_conf_nid(0, &ctx, nid, value);
+                check(extension != 0, "X509V3_EXT_conf_nid");
+                X509_add_ext(certificate, extension, -1);
+                X509_EXTENSION_free(extension);
+            }
+        }
+
+        tls_context::tls_context(const std::string &certificate_file, const std::string &key_file)
+                : context_(SSL_CTX_new(TLS_server_method())) {
+            check(context_ != 0, "SSL_CTX_new");
+            SSL_CTX_set_min_proto_version(context_, TLS1_2_VERSION);
+            SSL_CTX_set_options(context_, SSL_OP_ENABLE_KTLS | SSL_OP_NO_COMPRESSION | SSL_OP_NO_RENEGOTIATION
+                                          | SSL_OP_CIPHER_SERVER_PREFERENCE);
+            SSL_CTX_set_mode(context_, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+                                       | SSL_MODE_RELEASE_BUFFERS);
+            SSL_CTX_set_cipher_list(context_, "ECDHE+AESGCM:ECDHE+CHACHA20");
+
+            try {
+                if (certificate_file.empty()) {
+                    use_self_signed();
+                } else {
+                    check(SSL_CTX_use_certificate_chain_file(context_, certificate_file.c_str()) == 1,
+                          "SSL_CTX_use_certificate_chain_file");
+                    check(SSL_CTX_use_PrivateKey_file(context_, key_file.empty() ? certificate_file.c_str()
+                                                                                 : key_file.c_str(),
+                                                      SSL_FILETYPE_PEM) == 1, "SSL_CTX_use_PrivateKey_file");
+                    check(SSL_CTX_check_private_key(context_) == 1, "SSL_CTX_check_private_key");
+                }
+            }
+            catch (...) {
+                SSL_CTX_free(context_);
+                throw;
+            }
+        }
+
+        tls_context::~tls_context() {
+            SSL_CTX_free(context_);
+        }
+
+        void tls_context::enable_http2() {
+            protocols_.assign("\x02h2\x08http/1.1", 12);
+            SSL_CTX_set_alpn_select_cb(context_, &tls_context::select_protocol, this);
+        }
+
+        int tls_context::select_protocol(SSL *, const unsigned char **out, unsigned char *out_length,
+                                         const unsigned char *in, unsigned int in_length, void *arg) {
+            const std::string &protocols = static_cast<tls_context *>(arg)->protocols_;
+            unsigned char *selected;
+            if (SSL_select_next_proto(&selected, out_length, reinterpret_cast<const unsigned char *>(protocols.data()),
+                                      static_cast<unsigned int>(protocols.size()), in, in_length)
+                != OPENSSL_NPN_NEGOTIATED)
+                return SSL_TLSEXT_ERR_NOACK;
+            *out = selected;
+            return SSL_TLSEXT_ERR_OK;
+        }
+
+        void tls_context::use_self_signed() {
+            EVP_PKEY *key = EVP_EC_gen("P-256");
+            check(key != 0, "EVP_EC_gen");
+            X509 *certificate = X509_new();
+            if (!certificate) {
+                EVP_PKEY_free(key);
+                check(false, "X509_new");
+            }
+
+            try {
+                X509_set_version(certificate, 2);
+                ASN1_INTEGER_set(X509_get_serialNumber(certificate), static_cast<long>(std::time(0)));
+                X509_gmtime_adj(X509_getm_notBefore(certificate), -60);
+                X509_gmtime_adj(X509_getm_notAfter(certificate), self_signed_days * 24 * 60 * 60);
+                X509_set_pubkey(certificate, key);
+                X509_NAME *name = X509_get_subject_name(certificate);
+                X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                           reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+                X509_set_issuer_name(certificate, name);
+                add_extension(certificate, NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1,IP:::1");
+                add_extension(certificate, NID_basic_constraints, "critical,CA:FALSE");
+                check(X509_sign(certificate, key, EVP_sha256()) > 0, "X509_sign");
+                check(SSL_CTX_use_certificate(context_, certificate) == 1, "SSL_CTX_use_certificate");
+                check(SSL_CTX_use_PrivateKey(context_, key) == 1, "SSL_CTX_use_PrivateKey");
+            }
+            catch (...) {
+                X509_free(certificate);
+                EVP_PKEY_free(key);
+                throw;
+            }
+            X509_free(certificate);
+            EVP_PKEY_free(key);
+            HTTP_SERVER3_LOG(warning, "Serving TLS with a self-signed certificate for localhost");
+        }
+
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef HTTP_SERVER3_TLS_CONTEXT_HPP
+#define HTTP_SERVER3_TLS_CONTEXT_HPP
+
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <openssl/ssl.h>
+
+namespace http {
+    namespace server3 {
+
+        class tls_context : private boost::noncopyable {
+        public:
+            tls_context(const std::string &certificate_file, const std::string &key_file);
+
+            ~tls_context();
+
+            void enable_http2();
+
+            SSL_CTX *native_handle() {
+                return context_;
+            }
+
+        private:
+            void use_self_signed();
+
+            static int select_protocol(SSL *ssl, const unsigned char **out, unsigned char *out_length,
+                                       const unsigned char *in, unsigned int in_length, void *arg);
+
+            SSL_CTX *context_;
+
+            std::string protocols_;
+        };
+
+    }
+}
+
+#endif
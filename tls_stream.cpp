@@ -0,0 +1,55 @@
+#include "tls_stream.hpp"
+#include <cerrno>
+#include <boost/asio/ssl/error.hpp>
+
+namespace http {
+    namespace server3 {
+
+        tls_stream::tls_stream(tls_context &context, boost::asio::ip::tcp::socket &socket)
+                : socket_(socket),
+                  ssl_(SSL_new(context.native_handle())) {
+            if (!ssl_)
+                throw boost::system::system_error(error(SSL_ERROR_SSL), "SSL_new");
+            socket_.native_non_blocking(true);
+            SSL_set_fd(ssl_, socket_.native_handle());
+            SSL_set_accept_state(ssl_);
+        }
+
+        tls_stream::~tls_stream() {
+            SSL_free(ssl_);
+        }
+
+        bool tls_stream::kernel_send() const {
+            return BIO_get_ktls_send(SSL_get_wbio(ssl_));
+        }
+
+        bool tls_stream::kernel_receive() const {
+            return BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+        }
+
+        boost::string_view tls_stream::protocol() const {
+            const unsigned char *name;
+            unsigned int length;
+            SSL_get0_alpn_selected(ssl_, &name, &length);
+            return boost::string_view(reinterpret_cast<const char *>(name), length);
+        }
+
+        void tls_stream::shutdown() {
+            ERR_clear_error();
+            if (SSL_is_init_finished(ssl_))
+                SSL_shutdown(ssl_);
+        }
+
+        boost::system::error_code tls_stream::error(int code) {
+            if (code == SSL_ERROR_ZERO_RETURN)
+                return boost::asio::error::eof;
+            if (code == SSL_ERROR_SYSCALL && ERR_peek_error() == 0)
+                return errno != 0 ? boost::system::error_code(errno, boost::system::system_category())
+                                  : boost::system::error_code(boost::asio::error::eof);
+            boost::system::error_code ec(static_cast<int>(ERR_get_error()), boost::asio::error::get_ssl_category());
+            ERR_clear_error();
+            return ec;
+        }
+
+    }
+}
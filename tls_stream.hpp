@@ -0,0 +1,208 @@
+#ifndef HTTP_SERVER3_TLS_STREAM_HPP
+#define HTTP_SERVER3_TLS_STREAM_HPP
+
+#include <algorithm>
+#include <climits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/utility/string_view.hpp>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include "tls_context.hpp"
+
+namespace http {
+    namespace server3 {
+
+        class tls_stream : private boost::noncopyable {
+        public:
+            typedef boost::asio::ip::tcp::socket::executor_type executor_type;
+
+            tls_stream(tls_context &context, boost::asio::ip::tcp::socket &socket);
+
+            ~tls_stream();
+
+            executor_type get_executor() {
+                return socket_.get_executor();
+            }
+
+            bool kernel_send() const;
+
+            bool kernel_receive() const;
+
+            boost::string_view protocol() const;
+
+            void shutdown();
+
+            template<typename Handler>
+            void async_handshake(Handler &&handler) {
+                start(handshake_operation(), handler);
+            }
+
+            template<typename MutableBufferSequence, typename Handler>
+            void async_read_some(const MutableBufferSequence &buffers, Handler &&handler) {
+                boost::asio::mutable_buffer buffer;
+                for (auto it = boost::asio::buffer_sequence_begin(buffers);
+                     it != boost::asio::buffer_sequence_end(buffers) && buffer.size() == 0; ++it)
+                    buffer = *it;
+                start(read_operation(buffer), handler);
+            }
+
+            template<typename ConstBufferSequence, typename Handler>
+            void async_write_some(const ConstBufferSequence &buffers, Handler &&handler) {
+                start(write_operation(stage(buffers)), handler);
+            }
+
+        private:
+            static const std::size_t record_size = 16384;
+
+            struct handshake_operation {
+                int operator()(SSL *ssl, std::size_t &) const {
+                    return SSL_do_handshake(ssl);
+                }
+            };
+
+            struct read_operation {
+                explicit read_operation(boost::asio::mutable_buffer b) : buffer(b) {}
+
+                int operator()(SSL *ssl, std::size_t &bytes) const {
+                    int result = SSL_read(ssl, buffer.data(), static_cast<int>(std::min<std::size_t>(buffer.size(),
+                                                                                                     INT_MAX)));
+                    if (result > 0)
+                        bytes = static_cast<std::size_t>(result);
+                    return result;
+                }
+
+                boost::asio::mutable_buffer buffer;
+            };
+
+            struct write_operation {
+                explicit write_operation(boost::asio::const_buffer b) : buffer(b) {}
+
+                int operator()(SSL *ssl, std::size_t &bytes) const {
+                    int result = SSL_write(ssl, buffer.data(), static_cast<int>(std::min<std::size_t>(buffer.size(),
+                                                                                                      INT_MAX)));
+                    if (result > 0)
+                        bytes = static_cast<std::size_t>(result);
+                    return result;
+                }
+
+                boost::asio::const_buffer buffer;
+            };
+
+            template<typename Operation, typename Handler>
+            class io_op {
+            public:
+                typedef typename boost::asio::associated_executor<Handler, tls_stream::executor_type>::type executor_type;
+
+                typedef typename boost::asio::associated_allocator<Handler>::type allocator_type;
+
+                io_op(tls_stream &stream, const Operation &operation, Handler &handler)
+                        : stream_(stream), operation_(operation), handler_(std::move(handler)), waited_(false),
+                          complete_(false), bytes_(0) {}
+
+                executor_type get_executor() const {
+                    return boost::asio::get_associated_executor(handler_, stream_.socket_.get_executor());
+                }
+
+                allocator_type get_allocator() const {
+                    return boost::asio::get_associated_allocator(handler_);
+                }
+
+                void operator()(const boost::system::error_code &e = boost::system::error_code()) {
+                    if (complete_) {
+                        handler_(error_, bytes_);
+                        return;
+                    }
+                    if (e) {
+                        finish(e);
+                        return;
+                    }
+
+                    ERR_clear_error();
+                    int result = operation_(stream_.ssl_, bytes_);
+                    if (result > 0) {
+                        finish(boost::system::error_code());
+                        return;
+                    }
+                    int code = SSL_get_error(stream_.ssl_, result);
+                    if (code == SSL_ERROR_WANT_READ || code == SSL_ERROR_WANT_WRITE) {
+                        waited_ = true;
+                        stream_.socket_.async_wait(code == SSL_ERROR_WANT_READ
+                                                   ? boost::asio::ip::tcp::socket::wait_read
+                                                   : boost::asio::ip::tcp::socket::wait_write, std::move(*this));
+                        return;
+                    }
+                    finish(tls_stream::error(code));
+                }
+
+            private:
+                void finish(const boost::system::error_code &e) {
+                    if (waited_) {
+                        handler_(e, bytes_);
+                        return;
+                    }
+                    complete_ = true;
+                    error_ = e;
+                    boost::asio::post(std::move(*this));
+                }
+
+                tls_stream &stream_;
+
+                Operation operation_;
+
+                Handler handler_;
+
+                bool waited_;
+
+                bool complete_;
+
+                boost::system::error_code error_;
+
+                std::size_t bytes_;
+            };
+
+            template<typename Operation, typename Handler>
+            void start(const Operation &operation, Handler &handler) {
+                io_op<Operation, typename std::decay<Handler>::type>(*this, operation, handler)();
+            }
+
+            template<typename ConstBufferSequence>
+            boost::asio::const_buffer stage(const ConstBufferSequence &buffers) {
+                auto it = boost::asio::buffer_sequence_begin(buffers);
+                auto end = boost::asio::buffer_sequence_end(buffers);
+                while (it != end && boost::asio::const_buffer(*it).size() == 0)
+                    ++it;
+                if (it == end)
+                    return boost::asio::const_buffer();
+
+                boost::asio::const_buffer first(*it);
+                auto next = it;
+                if (first.size() >= record_size || ++next == end)
+                    return first;
+
+                staging_.clear();
+                for (; it != end && staging_.size() < record_size; ++it) {
+                    boost::asio::const_buffer b(*it);
+                    std::size_t take = std::min(b.size(), record_size - staging_.size());
+                    const char *data = static_cast<const char *>(b.data());
+                    staging_.insert(staging_.end(), data, data + take);
+                }
+                return boost::asio::buffer(staging_);
+            }
+
+            static boost::system::error_code error(int code);
+
+            boost::asio::ip::tcp::socket &socket_;
+
+            SSL *ssl_;
+
+            std::vector<char> staging_;
+        };
+
+    }
+}
+
+#endif
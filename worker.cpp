@@ -0,0 +1,83 @@
+#include "worker.hpp"
+#include "logging.hpp"
+#include <boost/bind.hpp>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace http {
+    namespace server3 {
+
+        worker::worker(const boost::asio::ip::tcp::endpoint &endpoint, request_handler &handler,
+                       bool use_io_uring, bandwidth_shaper *shaper, admission_control *admission,
+                       tls_context *tls, bool http2)
+                : io_context_(1),
+                  acceptor_(io_context_),
+                  new_connection_(),
+                  request_handler_(handler) {
+            if (admission)
+                probe_.reset(new admission_control::probe(*admission, io_context_));
+            if (use_io_uring) {
+#if defined(__linux__)
+                try {
+                    io_uring_.reset(new io_uring_service(io_context_));
+                }
+                catch (boost::system::system_error &e) {
+                    HTTP_SERVER3_LOG(warning, "io_uring unavailable (" << e.what() << "), using the reactor backend");
+                }
+#endif
+            }
+
+            acceptor_.open(endpoint.protocol());
+            acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#if defined(SO_REUSEPORT)
+            acceptor_.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+            acceptor_.bind(endpoint);
+            acceptor_.listen();
+
+            connections_.reset(new connection_pool(io_context_, request_handler_, io_uring_.get(), true, shaper,
+                                                   admission, tls, http2));
+            start_accept();
+        }
+
+        void worker::run(std::size_t cpu) {
+#if defined(__linux__)
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu, &cpus);
+            if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+                HTTP_SERVER3_LOG(warning, "could not pin worker to cpu " << cpu);
+#else
+            (void) cpu;
+#endif
+            io_context_.run();
+        }
+
+        void worker::stop() {
+            io_context_.stop();
+        }
+
+        bool worker::has_io_uring() const {
+            return io_uring_.get() != 0;
+        }
+
+        void worker::start_accept() {
+            new_connection_ = connections_->acquire();
+            acceptor_.async_accept(new_connection_->socket(),
+                                   make_custom_alloc_handler(accept_memory_,
+                                                             boost::bind(&worker::handle_accept, this,
+                                                                         boost::asio::placeholders::error)));
+        }
+
+        void worker::handle_accept(const boost::system::error_code &e) {
+            if (!e) {
+                new_connection_->start();
+            }
+
+            start_accept();
+        }
+
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef HTTP_SERVER3_WORKER_HPP
+#define HTTP_SERVER3_WORKER_HPP
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "connection.hpp"
+#include "connection_pool.hpp"
+#include "handler_allocator.hpp"
+#include "request_handler.hpp"
+#include "io_uring_service.hpp"
+#include "bandwidth_shaper.hpp"
+#include "admission_control.hpp"
+#include "tls_context.hpp"
+
+namespace http {
+    namespace server3 {
+
+        class worker
+                : private boost::noncopyable {
+        public:
+            explicit worker(const boost::asio::ip::tcp::endpoint &endpoint, request_handler &handler,
+                            bool use_io_uring, bandwidth_shaper *shaper = 0, admission_control *admission = 0,
+                            tls_context *tls = 0, bool http2 = false);
+
+            void run(std::size_t cpu);
+
+            void stop();
+
+            bool has_io_uring() const;
+
+        private:
+            void start_accept();
+
+            void handle_accept(const boost::system::error_code &e);
+
+            handler_memory accept_memory_;
+
+            boost::asio::io_context io_context_;
+
+            boost::scoped_ptr<admission_control::probe> probe_;
+
+            boost::asio::ip::tcp::acceptor acceptor_;
+
+            connection_ptr new_connection_;
+
+            request_handler &request_handler_;
+
+            boost::scoped_ptr<io_uring_service> io_uring_;
+
+            boost::scoped_ptr<connection_pool> connections_;
+        };
+
+    }
+}
+
+#endif